@@ -0,0 +1,344 @@
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "emitter.hpp"
+#include "field.hpp"
+#include "fluid.hpp"
+
+// Per-kernel microbenchmark and golden-output check for the fluid kernels.
+//
+//   rocket_bench [--sizes 64,128,...] [--min-time SECONDS]
+//   rocket_bench --check FILE
+//   rocket_bench --write-golden FILE
+//
+// Timing mode runs each kernel in isolation on synthetic fields and reports
+// cells/sec and an estimate of bytes/sec from a streaming traffic model.
+// Check mode runs each kernel once on a small grid and compares every output
+// field to the reference stored in FILE; it exits non-zero on mismatch.
+// Kernels with versions compiled for fixed grid sizes are checked once more
+// at one of those sizes, since the small grid only reaches the generic one.
+
+namespace {
+
+  const int    GOLDEN_SIZE      = 24;
+  const int    SPECIALIZED_SIZE = 64;
+  const double GOLDEN_TOL  = 1e-8;
+
+  const double DT          = 33.333333 / 100.0;
+  const double DIFFUSE     = 5.0;
+  const double DENSITY     = 0.001;
+
+  class grid {
+    private:
+      int                 n;
+      std::vector<double> data;
+      std::vector<double*> rows;
+
+    public:
+      explicit grid (int T) : n(T + 1), data(n * n, 0.0), rows(n) {
+        for (int i = 0; i < n; ++i) rows[i] = &data[i * n];
+      }
+
+      double**                   get  ()       noexcept { return rows.data(); }
+      const std::vector<double>& cells() const noexcept { return data; }
+      std::vector<double>&       cells()       noexcept { return data; }
+  };
+
+  // deterministic smooth pattern plus hashed noise in [-amp, amp]
+  void fill (grid& g, int T, uint32_t seed, double amp) {
+    uint32_t state = seed * 2654435761u + 1u;
+    double** f = g.get();
+    for (int i = 0; i <= T; ++i) {
+      for (int j = 0; j <= T; ++j) {
+        state = state * 1664525u + 1013904223u;
+        const double noise  = (state >> 8) / double(1u << 24) * 2.0 - 1.0;
+        const double smooth = std::sin(6.28318530718 * i / T + seed) * std::cos(6.28318530718 * j / T);
+        f[i][j] = amp * (0.7 * smooth + 0.3 * noise);
+      }
+    }
+  }
+
+  struct fields {
+    grid  x, x0, u, v, p, w_x, w_y, force;
+    field uniform_force, sparse_force;
+    std::vector<fluid::source> sources;
+
+    explicit fields (int T)
+      : x(T), x0(T), u(T), v(T), p(T), w_x(T), w_y(T), force(T),
+        uniform_force(T, 0.3), sparse_force(T, 0.3)
+    {
+      fill(x0,    T, 1, 1.0);
+      fill(u,     T, 2, 3.0);
+      fill(v,     T, 3, 3.0);
+      fill(force, T, 4, 0.3);
+
+      // a small square patch of overrides, as an emitter or obstacle would leave
+      for (int i = T / 2 - 4; i < T / 2 + 4; ++i) {
+        for (int j = T / 2 - 4; j < T / 2 + 4; ++j) {
+          sparse_force.set(i, j, -1.0);
+        }
+      }
+
+      // an engine nozzle holding x and pushing y, and a soft cloud doing
+      // the opposite, as the emitters of a step would leave them
+      emitter nozzle(0.5f, 0.75f), cloud(0.3f, 0.4f);
+      nozzle
+        .set_density  (75)
+        ->set_velocity (0, 900, emitter::mode::set, emitter::mode::add);
+      cloud
+        .set_shape    (emitter::shape::disc, 0.3f, 0.2f)
+        ->set_falloff  (emitter::falloff::gaussian)
+        ->set_density  (5)
+        ->set_velocity (2, -1, emitter::mode::add, emitter::mode::set);
+
+      for (const emitter* e : { &nozzle, &cloud }) {
+        fluid::source s;
+        if (e->rasterize(T, &s)) sources.push_back(s);
+      }
+    }
+
+    void reset_outputs (int T) {
+      fill(x, T, 5, 1.0);
+      std::fill(p.cells().begin(),   p.cells().end(),   0.0);
+      std::fill(w_x.cells().begin(), w_x.cells().end(), 0.0);
+      std::fill(w_y.cells().begin(), w_y.cells().end(), 0.0);
+    }
+  };
+
+  struct kernel {
+    const char* name;
+    // bytes moved per cell per call, assuming each field is streamed once per sweep
+    double      bytes_per_cell;
+    void (*run) (int T, fields& f);
+    // names and accessors of the output fields checked against the golden file
+    std::vector<std::pair<const char*, grid fields::*>> outputs;
+    // whether the kernel dispatches to versions compiled for fixed sizes
+    bool        specialized = false;
+  };
+
+  const std::vector<kernel>& kernels () {
+    static const std::vector<kernel> list {
+      {
+        "advect", 8.0 * 4,
+        [] (int T, fields& f) {
+          fluid::advect(T, f.x.get(), f.x0.get(), f.u.get(), f.v.get(), DT);
+        },
+        { {"x", &fields::x} }
+      },
+      {
+        "diffuse", 8.0 * 3 * 20,
+        [] (int T, fields& f) {
+          fluid::diffuse(T, f.x.get(), f.x0.get(), DIFFUSE, DT);
+        },
+        { {"x", &fields::x} },
+        true
+      },
+      {
+        "pressure", 8.0 * (4 * 20 + 5),
+        [] (int T, fields& f) {
+          fluid::pressure(T, f.p.get(), f.w_x.get(), f.w_y.get(), f.u.get(), f.v.get(), DENSITY);
+        },
+        { {"p", &fields::p}, {"w_x", &fields::w_x}, {"w_y", &fields::w_y} },
+        true
+      },
+      {
+        "body_force", 8.0 * 3,
+        [] (int T, fields& f) {
+          fluid::body_force(T, f.x.get(), f.x0.get(), f.force.get(), DT);
+        },
+        { {"x", &fields::x} }
+      },
+      {
+        "diffuse_adi", 8.0 * 3 * 2,
+        [] (int T, fields& f) {
+          fluid::diffuse_adi(T, f.x.get(), f.x0.get(), DIFFUSE, DT);
+        },
+        { {"x", &fields::x} }
+      },
+      {
+        "bf_uniform", 8.0 * 2,
+        [] (int T, fields& f) {
+          fluid::body_force(T, f.x.get(), f.x0.get(), f.uniform_force, DT);
+        },
+        { {"x", &fields::x} }
+      },
+      {
+        "bf_sparse", 8.0 * 2,
+        [] (int T, fields& f) {
+          fluid::body_force(T, f.x.get(), f.x0.get(), f.sparse_force, DT);
+        },
+        { {"x", &fields::x} }
+      },
+      {
+        "emit", 8.0 * 2,
+        [] (int T, fields& f) {
+          fluid::emit(T, f.x.get(), f.sources, fluid::DENSITY, DT, 0, T);
+        },
+        { {"x", &fields::x} }
+      },
+      {
+        "bf_sources", 8.0 * 2 * 2,
+        [] (int T, fields& f) {
+          fluid::body_force(T, f.w_x.get(), f.u.get(), f.sparse_force,  DT, f.sources, fluid::VELOCITY_X, 0, T);
+          fluid::body_force(T, f.w_y.get(), f.v.get(), f.uniform_force, DT, f.sources, fluid::VELOCITY_Y, 0, T);
+        },
+        { {"w_x", &fields::w_x}, {"w_y", &fields::w_y} }
+      },
+    };
+    return list;
+  }
+
+  // every kernel and grid size in the golden file, in file order
+  std::vector<std::pair<const kernel*, int>> golden_runs () {
+    std::vector<std::pair<const kernel*, int>> runs;
+    for (const kernel& k : kernels()) runs.push_back({ &k, GOLDEN_SIZE });
+    for (const kernel& k : kernels()) {
+      if (k.specialized) runs.push_back({ &k, SPECIALIZED_SIZE });
+    }
+    return runs;
+  }
+
+  std::vector<int> parse_sizes (const std::string& list) {
+    std::vector<int> sizes;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) sizes.push_back(std::stoi(item));
+    return sizes;
+  }
+
+  int run_timing (const std::vector<int>& sizes, double min_time) {
+    using clock = std::chrono::steady_clock;
+
+    std::printf("%-12s %6s %8s %14s %14s %12s\n",
+        "kernel", "size", "reps", "ms/call", "Mcells/s", "GB/s");
+
+    for (int T : sizes) {
+      fields f(T);
+      for (const kernel& k : kernels()) {
+        int    reps    = 0;
+        double elapsed = 0.0;
+        while (reps == 0 || elapsed < min_time) {
+          f.reset_outputs(T);
+          const clock::time_point start = clock::now();
+          k.run(T, f);
+          elapsed += std::chrono::duration<double>(clock::now() - start).count();
+          ++reps;
+        }
+        const double per_call = elapsed / reps;
+        const double cells    = double(T) * T;
+        std::printf("%-12s %6d %8d %14.3f %14.2f %12.2f\n",
+            k.name, T, reps,
+            per_call * 1e3,
+            cells / per_call / 1e6,
+            cells * k.bytes_per_cell / per_call / 1e9);
+      }
+    }
+    return EXIT_SUCCESS;
+  }
+
+  int write_golden (const std::string& path) {
+    std::ofstream out(path);
+    if (!out) {
+      std::cerr << "Could not open " << path << " for writing" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    char buf[32];
+    for (const auto& run : golden_runs()) {
+      const kernel& k = *run.first;
+      const int     T = run.second;
+      fields f(T);
+      f.reset_outputs(T);
+      k.run(T, f);
+      for (const auto& o : k.outputs) {
+        out << k.name << " " << o.first << " " << T << "\n";
+        for (double value : (f.*o.second).cells()) {
+          std::snprintf(buf, sizeof(buf), "%.17g", value);
+          out << buf << "\n";
+        }
+      }
+    }
+    return EXIT_SUCCESS;
+  }
+
+  int check_golden (const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+      std::cerr << "Could not open " << path << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    int failures = 0;
+    for (const auto& run : golden_runs()) {
+      const kernel& k = *run.first;
+      const int     T = run.second;
+      fields f(T);
+      f.reset_outputs(T);
+      k.run(T, f);
+      for (const auto& o : k.outputs) {
+        std::string name, output;
+        int size = 0;
+        in >> name >> output >> size;
+        if (!in || name != k.name || output != o.first || size != T) {
+          std::cerr << "Malformed golden file at " << k.name << "." << o.first << std::endl;
+          return EXIT_FAILURE;
+        }
+
+        const std::vector<double>& actual = (f.*o.second).cells();
+        std::vector<double> expected(actual.size());
+        double scale = 0.0;
+        for (double& value : expected) {
+          in >> value;
+          scale = std::max(scale, std::abs(value));
+        }
+
+        double max_err = 0.0;
+        for (size_t c = 0; c < actual.size(); ++c) {
+          max_err = std::max(max_err, std::abs(actual[c] - expected[c]));
+        }
+
+        // NaN compares false, so test for the passing case explicitly
+        const bool ok = max_err <= GOLDEN_TOL * std::max(1.0, scale);
+        std::printf("%-12s %-4s %4d max error %.3e %s\n", k.name, o.first, T, max_err, ok ? "ok" : "FAILED");
+        failures += !ok;
+      }
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+}
+
+int main (int argc, char** argv) {
+  std::vector<int> sizes { 64, 128, 256, 512, 1024, 2048, 4096 };
+  double min_time = 0.25;
+
+  for (int a = 1; a < argc; ++a) {
+    const std::string arg = argv[a];
+    const bool has_value = a + 1 < argc;
+
+    if (arg == "--sizes" && has_value) {
+      sizes = parse_sizes(argv[++a]);
+    } else if (arg == "--min-time" && has_value) {
+      min_time = std::atof(argv[++a]);
+    } else if (arg == "--check" && has_value) {
+      return check_golden(argv[++a]);
+    } else if (arg == "--write-golden" && has_value) {
+      return write_golden(argv[++a]);
+    } else {
+      std::cerr << "usage: " << argv[0]
+        << " [--sizes N,N,...] [--min-time S] [--check FILE] [--write-golden FILE]" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return run_timing(sizes, min_time);
+}
@@ -0,0 +1,141 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "field_export.hpp"
+
+// Maps the fields exported by `rocket --export NAME` and verifies frames in
+// place, without copying them out of shared memory.
+//
+//   rocket_shm_reader NAME [FRAMES]
+//
+// Prints one line per verified frame and a summary of frames that were
+// skipped (overwritten before this reader got to them) or torn (rewritten
+// while being read). Exits non-zero if a complete frame fails its checksum.
+
+using namespace shm_export;
+
+int main (int argc, char** argv) {
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: %s NAME [FRAMES]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  const std::string path   = std::string("/") + argv[1];
+  const long        frames = argc > 2 ? std::atol(argv[2]) : 100;
+
+  const int fd = shm_open(path.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    std::perror(("shm_open " + path).c_str());
+    return EXIT_FAILURE;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    std::perror(("fstat " + path).c_str());
+    close(fd);
+    return EXIT_FAILURE;
+  }
+  if ((size_t) st.st_size < sizeof(export_header)) {
+    std::fprintf(stderr, "%s is too small to be a rocket field export\n", path.c_str());
+    close(fd);
+    return EXIT_FAILURE;
+  }
+
+  void* memory = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    std::perror(("mmap " + path).c_str());
+    return EXIT_FAILURE;
+  }
+
+  const export_header* header = static_cast<const export_header*>(memory);
+  if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION) {
+    std::fprintf(stderr, "%s is not a rocket field export (version %u)\n", path.c_str(), VERSION);
+    return EXIT_FAILURE;
+  }
+
+  const uint32_t T     = header->grid_size;
+  const size_t   cells = (size_t) T * T;
+
+  // every slot, and every field within one, must lie inside the object,
+  // or reading a truncated or foreign object would fault
+  const size_t size    = (size_t) st.st_size;
+  const bool   fits    =
+    header->slot_count > 0 &&
+    header->field_count == FIELDS &&
+    header->payload_offset >= sizeof(export_slot) &&
+    header->slot_bytes >= header->payload_offset + header->field_count * cells * sizeof(double) &&
+    header->header_bytes >= sizeof(export_header) &&
+    header->header_bytes <= size &&
+    (size - header->header_bytes) / header->slot_bytes >= header->slot_count;
+  if (!fits) {
+    std::fprintf(stderr, "%s: header does not match the object's size (%zu bytes)\n", path.c_str(), size);
+    munmap(memory, st.st_size);
+    return EXIT_FAILURE;
+  }
+  std::printf("%s: %ux%u grid, %u fields, %u slots\n",
+      path.c_str(), T, T, header->field_count, header->slot_count);
+
+  long     verified = 0, skipped = 0, torn = 0, corrupt = 0;
+  uint64_t last     = 0;
+
+  while (verified < frames) {
+    const uint64_t n = header->latest.load(std::memory_order_acquire);
+    if (n == 0 || n == last) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    const char* base = static_cast<const char*>(memory)
+      + header->header_bytes + (n % header->slot_count) * header->slot_bytes;
+    const export_slot* slot    = reinterpret_cast<const export_slot*>(base);
+    const double*      payload = reinterpret_cast<const double*>(base + header->payload_offset);
+
+    const uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    if (sequence != 2 * n) {
+      // the writer is rewriting the slot, give it the time to finish
+      ++torn;
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+      continue;
+    }
+
+    // read in place: checksum and total density straight from the mapping
+    const uint64_t sum  = checksum(reinterpret_cast<const uint64_t*>(payload), header->field_count * cells);
+    double         mass = 0.0;
+    for (size_t c = 0; c < cells; ++c) mass += payload[c];
+    const uint64_t expected = slot->checksum;
+    const double   time     = slot->time;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot->sequence.load(std::memory_order_relaxed) != sequence) {
+      ++torn;
+      continue;
+    }
+
+    if (sum != expected) {
+      ++corrupt;
+      std::printf("frame %lu: checksum mismatch\n", (unsigned long) n);
+    } else {
+      std::printf("frame %lu  t=%.3f  density=%.6g\n", (unsigned long) n, time, mass);
+    }
+
+    if (last != 0) skipped += n - last - 1;
+    last = n;
+    ++verified;
+  }
+
+  std::printf("%ld frames verified, %ld skipped, %ld torn reads retried, %ld corrupt\n",
+      verified, skipped, torn, corrupt);
+
+  munmap(memory, st.st_size);
+  return corrupt == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,54 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// a single anonymous mapping carved into simulation grids
+//
+// the mapping is backed by explicit huge pages when the system has them
+// reserved, and otherwise asks for transparent huge pages. memory is never
+// touched by the arena itself (the row tables of the grids live on the
+// heap), so pages are placed on the NUMA node of whichever thread first
+// writes them.
+class arena {
+
+  private:
+
+    char*  mapping;
+    size_t mapped;
+
+    // 2 MB aligned start of the usable memory inside the mapping
+    char*  base;
+    size_t capacity;
+    size_t used;
+    bool   huge_pages;
+
+    // row tables of the grids handed out so far
+    std::vector<std::unique_ptr<double*[]>> tables;
+
+  public:
+
+    // bytes of the arena taken by grid(T)
+    static size_t grid_bytes (int T) noexcept;
+
+    void*    allocate (size_t bytes, size_t alignment = 64);
+
+    // (T+1) x (T+1) grid indexed as [i][j] with every row starting on a
+    // cache line; the cells are left untouched and the row table, which is
+    // not part of the arena, lives as long as the arena does
+    double** grid     (int T);
+
+    // whether huge pages were granted (explicit) or requested (transparent)
+    bool     uses_huge_pages () const noexcept { return huge_pages; }
+
+    // constructors
+    explicit arena (size_t bytes);
+    arena (const arena&) = delete;
+
+    // destructor
+    ~arena ();
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef EMITTER_HPP
+#define EMITTER_HPP
+
+#include "fluid.hpp"
+
+// a source of smoke and momentum, e.g. an engine nozzle or a ground cloud.
+// positions and sizes are fractions of the simulation domain, rates are per
+// unit of simulation time.
+class emitter {
+
+  public:
+
+    enum class shape   { point, disc, box };
+    enum class falloff { uniform, gaussian };
+
+    // how a velocity component is applied: added as an acceleration, or
+    // held at the given value
+    enum class mode    { add, set };
+
+  private:
+
+    shape   form;
+    falloff profile;
+    float   x, y;
+    float   width, height;
+    double  density;
+    double  velocity_x, velocity_y;
+    mode    mode_x, mode_y;
+    bool    enabled;
+
+  public:
+
+    float get_x       () const noexcept { return x; }
+    float get_y       () const noexcept { return y; }
+    bool  is_enabled  () const noexcept { return enabled; }
+
+    emitter* set_position (float x, float y)                     noexcept;
+    // a disc's width and height are its diameters, a point ignores both
+    emitter* set_shape    (shape form, float width, float height) noexcept;
+    emitter* set_falloff  (falloff profile)                       noexcept;
+    emitter* set_density  (double rate)                           noexcept;
+    emitter* set_velocity (double vx, double vy, mode mx = mode::add, mode my = mode::add) noexcept;
+    emitter* set_enabled  (bool enabled)                          noexcept;
+
+    // the cells this emitter covers on a T x T grid; false when it is
+    // disabled or entirely outside the grid
+    bool rasterize (int T, fluid::source* out) const noexcept;
+
+    // constructors
+    emitter (float x, float y);
+};
+
+#endif
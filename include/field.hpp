@@ -0,0 +1,58 @@
+#ifndef FIELD_HPP
+#define FIELD_HPP
+
+#include <utility>
+#include <vector>
+
+// a (T+1) x (T+1) scalar field stored in the most compact of three forms:
+//   uniform - a single value for every cell
+//   sparse  - a uniform base with a sorted list of per-cell overrides
+//   dense   - a full grid of rows, as used by the fluid kernels
+//
+// writes promote the storage as needed (uniform -> sparse -> dense),
+// set_uniform() demotes it back to a single value.
+class field {
+
+  public:
+
+    enum class storage { uniform, sparse, dense };
+
+    // (flat index i * (T+1) + j, value), sorted by index
+    using override_list = std::vector<std::pair<int, double>>;
+
+  private:
+
+    const int T;
+
+    storage               mode;
+    double                base;
+    override_list         overrides;
+    std::vector<double>   cells;
+    std::vector<double*>  rows;
+
+    void densify ();
+
+  public:
+
+    storage              get_storage   () const noexcept { return mode; }
+    double               get_uniform   () const noexcept { return base; }
+    const override_list& get_overrides () const noexcept { return overrides; }
+
+    // rows of a dense field, nullptr for any other storage
+    double**             get_rows () noexcept;
+    const double* const* get_rows () const noexcept;
+
+    double   at       (int i, int j) const noexcept;
+    double** to_dense ();
+
+    field* set_uniform (double value);
+    field* set         (int i, int j, double value);
+
+    // constructors
+    field (int T, double value = 0.0);
+    field (const field& f);
+
+    field& operator= (const field& f);
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef FIELD_EXPORT_HPP
+#define FIELD_EXPORT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Publishes the fields of every step into a POSIX shared memory object
+// (/dev/shm/<name>) so other local processes can map it and read frames in
+// place. The writer never waits for readers: frames go round a ring of
+// slots and a slow reader simply misses the ones that were overwritten.
+//
+// Layout, in host byte order:
+//
+//   export_header                          at offset 0
+//   slot k                                 at header_bytes + k * slot_bytes
+//     export_slot                          at the start of the slot
+//     field f, T x T doubles, row-major    at slot + payload_offset + f * T * T * 8
+//
+// Fields, in order: dens, vec_x, vec_y, each restricted to the T x T cells
+// (index i * T + j holds field[i][j]).
+//
+// Reading frame n, a seqlock:
+//   1. n = header.latest (acquire); 0 means nothing was published yet
+//   2. slot = n % slot_count, s = slot.sequence (acquire)
+//   3. if s != 2 * n the slot is being rewritten or already holds a newer frame
+//   4. read the payload, then issue an acquire fence
+//   5. the read is valid only if slot.sequence still equals s
+//
+// slot.checksum covers the payload as a sequence of 64-bit words w:
+//   a += w; b += a  (mod 2^64, both starting at 0), checksum = a ^ b
+namespace shm_export {
+
+  static const char     MAGIC[8] = { 'R', 'O', 'C', 'K', 'E', 'T', 'F', 'X' };
+  static const uint32_t VERSION  = 1;
+  static const uint32_t FIELDS   = 3;
+
+  struct export_header {
+    char                   magic[8];
+    uint32_t               version;
+    uint32_t               header_bytes;
+    uint32_t               grid_size;
+    uint32_t               field_count;
+    uint32_t               slot_count;
+    uint32_t               payload_offset;
+    uint64_t               slot_bytes;
+
+    // newest complete frame, frames are numbered from 1
+    std::atomic<uint64_t>  latest;
+  };
+
+  struct export_slot {
+    // 2 * frame once written, odd while a write is in progress
+    std::atomic<uint64_t>  sequence;
+    uint64_t               frame;
+    uint64_t               checksum;
+    double                 time;
+  };
+
+  // the checksum described above, of `words` 64-bit words
+  uint64_t checksum (const uint64_t* data, size_t words) noexcept;
+}
+
+class field_export {
+
+  private:
+
+    const std::string name;
+    const int         T;
+    const int         slots;
+
+    size_t                     bytes;
+    void*                      memory;
+    shm_export::export_header* header;
+
+    uint64_t  frame;
+    double    time;
+
+    // entry in the list of objects unlinked on SIGINT and SIGTERM
+    int       tracked;
+
+  public:
+
+    // copy one step's fields into the next slot; dt advances the frame time
+    void publish (double dt, double** dens, double** vec_x, double** vec_y) noexcept;
+
+    // constructors
+    // creates (or replaces) the shared memory object /dev/shm/<name>;
+    // throws std::invalid_argument unless T and slots are at least 1, and
+    // std::system_error when the object cannot be created or mapped
+    field_export (const std::string& name, int T, int slots);
+    field_export (const field_export&) = delete;
+
+    // destructor
+    // unmaps and unlinks the object; readers that still have it mapped keep
+    // their mapping. a SIGINT or SIGTERM unlinks every live object before the
+    // signal is passed on to its previous handler
+    ~field_export ();
+};
+
+#endif
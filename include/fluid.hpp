@@ -0,0 +1,97 @@
+#ifndef FLUID_HPP
+#define FLUID_HPP
+
+#include <chrono>
+#include <vector>
+
+#include "field.hpp"
+
+// grid kernels used by smoke_sim
+//
+// every field is a (T+1) x (T+1) array of rows indexed as field[i][j],
+// where cells 0 <= i, j < T are simulated and the extra row/column holds
+// the far faces of the staggered velocity grid.
+namespace fluid {
+
+  using solve_clock = std::chrono::steady_clock;
+
+  // how long an iterative solver may run: it stops after `iterations`
+  // sweeps or once `deadline` has passed, whichever comes first; the
+  // deadline is only checked between sweeps, so at least one always runs
+  struct solve_limit {
+    int                      iterations = 20;
+    solve_clock::time_point  deadline   = solve_clock::time_point::max();
+  };
+
+  // what a source writes to
+  enum component { DENSITY = 0, VELOCITY_X = 1, VELOCITY_Y = 2 };
+
+  // an emitter rasterized onto the grid: a rectangle of cells and how
+  // strongly each of them is driven
+  struct source {
+    // cells [i0, i1) x [j0, j1)
+    int    i0, i1, j0, j1;
+
+    // center and half extents in cell units
+    double cx, cy, rx, ry;
+
+    // weight = exp(-sharpness * r^2) with r = 1 on the edge of the shape,
+    // and zero outside it when round
+    double sharpness;
+    bool   round;
+
+    // density is added per unit time; a velocity is either added per unit
+    // time or, when set, blended towards by the weight
+    double value[3];
+    bool   set[3];
+  };
+
+  // semi-Lagrangian advection of x0 along (u, v) into x
+  void advect     (int T, double** x, double** x0, double** u, double** v, double dt);
+
+  // implicit diffusion of x0 into x by Gauss-Seidel relaxation
+  // (the overloads taking a solve_limit return the sweeps they completed)
+  void diffuse    (int T, double** x, double** x0, double k, double dt);
+  int  diffuse    (int T, double** x, double** x0, double k, double dt, const solve_limit& limit);
+
+  // implicit diffusion of x0 into x by alternating direction line solves:
+  // an exact tridiagonal solve along i for every column, then along j for
+  // every row. unlike Gauss-Seidel it needs no iterations however large k * dt
+  // is, at the cost of a splitting error of order (k * dt)^2
+  void diffuse_adi      (int T, double** x, double** x0, double k, double dt);
+
+  // the two passes of diffuse_adi on a range of lines, so they can be split
+  // across threads; all columns must finish the first pass before any row
+  // starts the second, which works in place on x
+  void diffuse_lines_i  (int T, double** x, double** x0, double k, double dt, int j_begin, int j_end);
+  void diffuse_lines_j  (int T, double** x, double k, double dt, int i_begin, int i_end);
+
+  // projects (w_x0, w_y0) onto a divergence free field (w_x, w_y),
+  // solving the pressure p as a by-product
+  void pressure   (int T, double** p, double** w_x, double** w_y, double** w_x0, double** w_y0, double density);
+  int  pressure   (int T, double** p, double** w_x, double** w_y, double** w_x0, double** w_y0, double density,
+                   const solve_limit& limit);
+
+  // explicit integration of an external force
+  void body_force (int T, double** u, double** u0, double** force, double dt);
+
+  // body_force specialized on the storage of the force field, so a uniform
+  // force never touches more memory than u and u0
+  void body_force (int T, double** u, double** u0, const field& force, double dt);
+
+  // advect and body_force restricted to rows [i_begin, i_end); every row only
+  // reads inputs and writes its own output, so disjoint ranges may run in parallel
+  void advect     (int T, double** x, double** x0, double** u, double** v, double dt, int i_begin, int i_end);
+  void body_force (int T, double** u, double** u0, const field& force, double dt, int i_begin, int i_end);
+
+  // apply the sources' `c` component to rows [i_begin, i_end) of x
+  void emit       (int T, double** x, const std::vector<source>& sources, component c, double dt, int i_begin, int i_end);
+
+  // body_force fused with emit on the same rows, one row at a time so that
+  // each row of u is written while it is still in cache
+  void body_force (int T, double** u, double** u0, const field& force, double dt,
+                   const std::vector<source>& sources, component c, int i_begin, int i_end);
+
+}
+
+#endif
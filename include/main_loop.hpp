@@ -4,9 +4,12 @@
 #include <cinttypes>
 #include <SDL2/SDL.h>
 
+#include <string>
 #include <vector>
 
+#include "scenario.hpp"
 #include "smoke_sim.hpp"
+#include "upscale.hpp"
 #include "object/object.hpp"
 
 #ifndef SIM_SIZE
@@ -17,6 +20,12 @@
 #define DT 33.333333f
 #endif
 
+// milliseconds a simulation step may take before the solvers are cut short,
+// leaving the rest of a 60 fps frame for rendering
+#ifndef FRAME_BUDGET
+#define FRAME_BUDGET 12.0f
+#endif
+
 class main_loop {
   private:
     int       m_window_width;
@@ -25,23 +34,60 @@ class main_loop {
     bool      m_continue_loop = true;
     bool      m_show_pressure = false;
     bool      m_pause         = false;
+    bool      m_upscale       = true;
+    bool      m_detail        = false;
+    bool      m_adi           = false;
+
+    // the run being played, and the frame it is at
+    const scenario m_script;
+    const int      m_sim_size;
+    const double   m_dt;
+    int            m_frame      = 0;
+    size_t         m_next_event = 0;
 
     SDL_Renderer* m_renderer;
+    SDL_Texture*  m_texture;
 
     // object list
     std::vector<object*> objs;
 
     // simulator
     smoke_sim* smoke;
+    // the exhaust of every rocket, in the order of objs
+    std::vector<emitter*> exhausts;
+
+    // window-sized reconstruction of the density
+    upscaler*  display;
     
     void clean_up         ();
     void keydown_callback (const SDL_Scancode scancode);
+    void play_events      ();
+    void reset            ();
+    void step             (double dt);
     void draw             (double dt);
+    void print_checksum   () const;
+    void print_solves     () const;
 
   public:
-    main_loop   (SDL_Window* window, int width, int height);
+    // a null window runs without rendering anything, see run_headless
+    main_loop   (SDL_Window* window, int width, int height, const scenario& script = default_scenario());
     void init   ();
     void start  ();
+
+    // destructor
+    // releases the objects, the simulation (and with it any shared memory
+    // export) and the SDL resources
+    ~main_loop  ();
+
+    // play the scenario's frames as fast as they simulate, without a window,
+    // then print the time taken and a checksum of the final state
+    void run_headless ();
+
+    // publish the simulated fields to shared memory on every step
+    void enable_export (const std::string& name);
+
+    // the built-in run: one rocket at the bottom, paused until `p` is pressed
+    static scenario default_scenario ();
 };
 
 #endif /* MAIN_LOOP_HPP */
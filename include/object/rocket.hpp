@@ -33,7 +33,11 @@ namespace model {
 
       std::pair<int, int> get_smoke_position (int T) const noexcept;
       rocket* set_position (float x, float y);
+      // fraction of the window travelled per unit of simulation time
+      rocket* set_velocity (float vx, float vy);
 
+      // a null renderer leaves the rocket without a texture, for runs that
+      // never draw it
       rocket (float x, float y, int s, SDL_Renderer* renderer);
 
       void cleanup ();
@@ -0,0 +1,100 @@
+#ifndef SCENARIO_HPP
+#define SCENARIO_HPP
+
+#include <string>
+#include <vector>
+
+#include "emitter.hpp"
+#include "smoke_sim.hpp"
+
+// A scripted run: the grid, fluid parameters, objects, emitters and a list
+// of events keyed by frame, so the same run can be repeated exactly, with or
+// without a window.
+//
+// A scenario file holds one directive per line; `#` starts a comment.
+// Densities and velocities of emitters are amounts per frame, positions and
+// sizes fractions of the domain. Every directive but `at` and the object
+// lines may appear once, later lines override earlier ones. A grid under 8,
+// a dt or rocket size that is not positive, and a negative frame count or
+// budget are errors.
+//
+//   grid 200                 cells per side (default: the build's SIM_SIZE)
+//   dt 33.333333             frame time in ms, each frame simulates dt / 100
+//   frames 600               frames a headless run lasts (default 300)
+//   budget 0                 frame budget of the solvers in ms, 0 (the
+//                            default) always runs them to completion
+//   diffuse 5
+//   viscosity 1
+//   density 0.001
+//   gravity 0 0.3
+//   solver gauss_seidel      or adi
+//
+//   rocket X Y SIZE [velocity VX VY] [exhaust DENSITY SPEED]
+//       a rocket moving by (VX, VY) per unit of simulation time (default
+//       0 -0.01) with an exhaust emitter at its base (default 25 300)
+//   emitter X Y [disc W H | box W H] [gaussian] [density D]
+//               [velocity VX VY [add|set] [add|set]]
+//       a fixed emitter, a point adding D density and (VX, VY) velocity
+//       unless told otherwise; a velocity component in `set` mode is held
+//       at its value rather than added every frame
+//
+//   at FRAME ACTION          ACTION is one of pause, resume, reset, pressure
+//                            (toggle the pressure view), upscale, detail,
+//                            gauss_seidel, adi or end
+//
+// Frames are counted from 0 whether the simulation is paused or not, and
+// all events of a frame apply, in file order, before it is simulated.
+struct scenario {
+
+  enum class action { pause, resume, reset, pressure, upscale, detail, gauss_seidel, adi, end };
+
+  struct event {
+    int    frame;
+    action what;
+  };
+
+  struct rocket_spec {
+    float  x, y;
+    int    size;
+    float  vx = 0.0f, vy = -0.01f;
+    double exhaust_density = 25;
+    double exhaust_speed   = 300;
+  };
+
+  struct emitter_spec {
+    float             x, y;
+    emitter::shape    form    = emitter::shape::point;
+    float             width   = 0;
+    float             height  = 0;
+    emitter::falloff  profile = emitter::falloff::uniform;
+    double            density = 0;
+    double            vx      = 0;
+    double            vy      = 0;
+    emitter::mode     mode_x  = emitter::mode::add;
+    emitter::mode     mode_y  = emitter::mode::add;
+  };
+
+  // 0 for the build's default grid and frame time
+  int    grid   = 0;
+  double dt     = 0;
+  int    frames = 300;
+  double budget = 0;
+
+  double diffuse   = 5;
+  double viscosity = 1;
+  double density   = 0.001;
+  double gravity_x = 0;
+  double gravity_y = 0.3;
+  smoke_sim::diffuse_solver solver = smoke_sim::diffuse_solver::gauss_seidel;
+
+  std::vector<rocket_spec>   rockets;
+  std::vector<emitter_spec>  emitters;
+
+  // sorted by frame
+  std::vector<event>         events;
+
+  // throws std::runtime_error naming the file and line of the first error
+  static scenario load (const std::string& path);
+};
+
+#endif
@@ -1,19 +1,60 @@
 #ifndef SMOKE_SIM_HPP
 #define SMOKE_SIM_HPP
 
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
 #include <utility>
+#include <vector>
+
+#include "arena.hpp"
+#include "emitter.hpp"
+#include "field.hpp"
+#include "field_export.hpp"
+#include "task_graph.hpp"
 
 class smoke_sim {
 
+  public:
+
+    // how the viscosity and density diffusions are solved
+    enum class diffuse_solver {
+      // relaxation sweeps, cut short by the frame budget
+      gauss_seidel,
+      // two passes of exact line solves, see fluid::diffuse_adi
+      adi
+    };
+
+    // sweeps completed by each iterative solve of the last step
+    // (an ADI diffusion always counts its two line passes)
+    struct solve_report {
+      int    viscosity_x = 0;
+      int    viscosity_y = 0;
+      int    pressure    = 0;
+      int    diffusion   = 0;
+
+      // sweeps each solve runs when it is not cut short
+      int    iterations  = 0;
+      double elapsed_ms  = 0.0;
+    };
+
   private:
 
     const int T;
 
+    // backing memory of every grid below
+    arena    memory;
+
     double   diffuse_rate;
     double   viscosity;
     double   density;
 
+    diffuse_solver solver;
+
     double** tmp_vec_x;
     double** tmp_vec_y;
     double** tmp_dens;
@@ -22,16 +63,50 @@ class smoke_sim {
     double** vec_y;
     double** dens;
     double** pressure;
-    double** force_x;
-    double** force_y;
+
+    // external forces, usually uniform (e.g. gravity)
+    field    force_x;
+    field    force_y;
+
+    // smoke sources, rasterized into `sources` at the start of every step
+    std::deque<emitter>         emitters;
+    std::vector<fluid::source>  sources;
+
+    // wall clock budget of one step in milliseconds, 0 for no budget
+    double   frame_budget;
+    std::chrono::steady_clock::time_point frame_start;
+    solve_report report;
+
+    // shared memory export of every step, when enabled
+    std::unique_ptr<field_export> exporter;
+
+    // the stages of one step and the threads running them
+    task_graph   step;
+    scheduler    workers;
 
     // overridable 
     virtual void evolve_vec_x () {};
     virtual void evolve_vec_y () {};
     virtual void evolve_dens  () {};
 
-    void evolve_vec  (double dt);
-    void evolve_dens (double dt);
+    // zero every grid from the thread whose row blocks will process it
+    void first_touch ();
+
+    // add a diffusion of x0 into x to `step`, storing its sweeps in `done`
+    task_graph::task_id add_diffuse (
+        const std::string& name,
+        double** x,
+        double** x0,
+        double k,
+        double dt,
+        double share,
+        int* done,
+        const std::vector<task_graph::task_id>& after
+        );
+
+    // add the stages of a step to `step`, returning the last one
+    task_graph::task_id evolve_vec  (double dt);
+    task_graph::task_id evolve_dens (double dt, task_graph::task_id after);
 
   public:
 
@@ -39,15 +114,43 @@ class smoke_sim {
     double** get_pressure () const noexcept;
     double** get_vec_x    () const noexcept;
     double** get_vec_y    () const noexcept;
-    double** get_force_x  () const noexcept;
-    double** get_force_y  () const noexcept;
+    field*   get_force_x  () noexcept;
+    field*   get_force_y  () noexcept;
+
+    // emitters are applied in the body force stage of every step; the
+    // returned pointers stay valid until clear_emitters
+    emitter* add_emitter    (float x, float y);
+    void     clear_emitters () noexcept;
 
-    void simulate (double dt);
+    // advance by dt; `alongside` runs concurrently with the step and must
+    // not touch the simulation's fields
+    void simulate (double dt, const std::function<void()>& alongside = nullptr);
     void reset    ();
 
     smoke_sim* set_diffuse   (float rate) noexcept;
     smoke_sim* set_viscosity (float rate) noexcept;
     smoke_sim* set_density    (double density) noexcept;
+    smoke_sim* set_diffuse_solver (diffuse_solver solver) noexcept;
+
+    // let the solvers stop early so a step takes about `ms` milliseconds;
+    // 0 (the default) always runs the full iteration count
+    smoke_sim* set_frame_budget (double ms) noexcept;
+
+    const solve_report& get_solve_report () const noexcept;
+
+    // 64-bit FNV-1a hash of the bits of every cell of dens, vec_x, vec_y and
+    // pressure, to confirm that two runs ended in the same state
+    uint64_t get_checksum () const noexcept;
+
+    // publish dens, vec_x and vec_y of every step to the shared memory
+    // object /dev/shm/<name> (see field_export.hpp for the layout)
+    smoke_sim* enable_export (const std::string& name, int slots = 8);
+
+    // the threads running the steps, free to use between them
+    scheduler* get_workers () noexcept;
+
+    // wall clock of every stage of the last step
+    std::vector<task_graph::stage_timing> get_stage_timings () const;
 
     std::pair<int, int> get_position (float x, float y) const noexcept;
 
@@ -0,0 +1,133 @@
+#ifndef TASK_GRAPH_HPP
+#define TASK_GRAPH_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// a set of tasks and the dependencies between them, run by a scheduler
+class task_graph {
+
+  public:
+
+    using task_id = int;
+
+    // wall clock of every task sharing a name, relative to the start of run
+    struct stage_timing {
+      std::string name;
+      double      start_ms;
+      double      end_ms;
+      // summed run time of the stage's tasks, above end - start when they overlapped
+      double      busy_ms;
+    };
+
+  private:
+
+    friend class scheduler;
+
+    struct task {
+      std::string           name;
+      std::function<void()> fn;
+      std::vector<task_id>  successors;
+      int                   dependencies;
+      double                start_ms;
+      double                end_ms;
+
+      // block `block` of `blocks` prefers the thread that owns that share of
+      // the rows, and only ever runs there when pinned
+      int                   block  = -1;
+      int                   blocks = 0;
+      bool                  pinned = false;
+    };
+
+    std::vector<task> tasks;
+
+  public:
+
+    task_id add (const std::string& name, std::function<void()> fn, const std::vector<task_id>& after = {});
+
+    // split rows [0, n) into `blocks` tasks running fn(begin, end) and
+    // return a task that completes once all of them have.
+    // blocks are queued on the thread owning their share of the rows, so the
+    // same rows land on the same thread from one stage to the next; a pinned
+    // block is never stolen by another thread
+    task_id add_rows (
+        const std::string& name,
+        int n,
+        int blocks,
+        std::function<void(int, int)> fn,
+        const std::vector<task_id>& after = {},
+        bool pinned = false
+        );
+
+    void clear () noexcept;
+    bool empty () const noexcept { return tasks.empty(); }
+
+    // timings of the last run, grouped by task name in order of first appearance
+    std::vector<stage_timing> get_timings () const;
+};
+
+// runs task graphs on a pool of threads; every thread owns a deque of ready
+// tasks, pops its own newest task first and steals the oldest task of
+// another thread when it runs dry.
+// on Linux the pool's threads are bound to one CPU each when there are
+// enough; worker 0, the caller of run, is left where the OS puts it
+class scheduler {
+
+  private:
+
+    struct worker_queue {
+      std::mutex                  lock;
+      std::deque<task_graph::task_id> ready;
+    };
+
+    const int                                   thread_count;
+    std::vector<std::unique_ptr<worker_queue>>  queues;
+    std::vector<std::thread>                    threads;
+
+    // what is queued, so a thread only wakes for work it may take:
+    // tasks in each worker's deque, and those of them that are not pinned
+    std::mutex              sleep_lock;
+    std::condition_variable wake;
+    std::vector<int>        held;
+    int                     stealable;
+    bool                    stop;
+
+    // state of the graph being run
+    task_graph*                       graph;
+    std::unique_ptr<std::atomic<int>[]> pending;
+    std::atomic<int>                  remaining;
+    std::chrono::steady_clock::time_point run_start;
+
+    void push      (int worker, task_graph::task_id id);
+    bool pop       (int worker, task_graph::task_id* id);
+    void execute   (int worker, task_graph::task_id id);
+    void work_loop (int worker);
+    // whether `worker` has a task it may run; sleep_lock must be held
+    bool has_work  (int worker) const noexcept { return held[worker] > 0 || stealable > 0; }
+
+  public:
+
+    int  get_thread_count () const noexcept { return thread_count; }
+
+    // run every task of the graph, blocking until all are done;
+    // the calling thread takes part as worker 0
+    void run (task_graph& graph);
+
+    // constructors
+    // 0 threads picks one per hardware thread
+    explicit scheduler (int threads = 0);
+    scheduler (const scheduler&) = delete;
+
+    // destructor
+    ~scheduler ();
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef UPSCALE_HPP
+#define UPSCALE_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "task_graph.hpp"
+
+// reconstructs a window-sized image from a coarse density grid
+//
+// the density is upsampled separably with a Catmull-Rom cubic clamped to
+// the two samples it falls between, which keeps it monotone (no ringing or
+// negative smoke around sharp plumes). optionally a sub-grid detail texture
+// is carried along by the coarse velocity and modulates the result.
+// both passes are split into row blocks on a scheduler and their inner loops
+// run over contiguous memory so they vectorize.
+class upscaler {
+
+  private:
+
+    const int T;
+    const int width;
+    const int height;
+
+    scheduler& workers;
+    task_graph passes;
+
+    // per output column / row: first of the four taps and their weights
+    std::vector<int>    tap_x,    tap_y;
+    std::vector<float>  weight_x, weight_y;
+
+    // per output column / row: cell and offset for bilinear velocity lookups
+    std::vector<int>    cell_x,   cell_y;
+    std::vector<float>  frac_x,   frac_y;
+
+    // dens transposed to [j][i] with two clamped cells of padding on each side
+    std::vector<float>  coarse;
+    // after the horizontal pass, one row of `width` samples per padded row
+    std::vector<float>  columns;
+
+    // detail texture and the static noise it relaxes towards
+    bool                detail_enabled;
+    float               detail_strength;
+    std::vector<float>  detail, detail_tmp, noise;
+    // cell centered velocity, [j][i]
+    std::vector<float>  velocity_x, velocity_y;
+
+    std::vector<uint32_t> pixels;
+
+    void horizontal_pass (int j_begin, int j_end);
+    void vertical_pass   (int y_begin, int y_end, uint32_t rgb);
+    void advect_rows     (int y_begin, int y_end, float dt);
+
+  public:
+
+    // carry the detail texture along the coarse velocity for dt
+    void advect_detail (double** vec_x, double** vec_y, double dt);
+
+    // ARGB8888 pixels, `width` per row, with the density as alpha
+    const uint32_t* render (double** dens, uint8_t r, uint8_t g, uint8_t b);
+
+    upscaler* set_detail (bool enabled, float strength = 0.35f) noexcept;
+    bool      has_detail () const noexcept { return detail_enabled; }
+
+    // constructors
+    upscaler (int T, int width, int height, scheduler& workers);
+};
+
+#endif
@@ -0,0 +1,83 @@
+#include <new>
+
+#include <sys/mman.h>
+
+#include "arena.hpp"
+
+namespace {
+
+  const size_t CACHE_LINE = 64;
+  const size_t HUGE_PAGE  = 2 * 1024 * 1024;
+
+  inline size_t round_up (size_t n, size_t multiple) {
+    return (n + multiple - 1) / multiple * multiple;
+  }
+
+  inline size_t row_stride (int T) {
+    return round_up((T+1) * sizeof(double), CACHE_LINE);
+  }
+}
+
+size_t arena::grid_bytes (int T) noexcept {
+  return (T+1) * row_stride(T);
+}
+
+void* arena::allocate (size_t bytes, size_t alignment) {
+  const size_t start = round_up(this->used, alignment);
+  if (start + bytes > this->capacity) throw std::bad_alloc();
+
+  this->used = start + bytes;
+  return this->base + start;
+}
+
+double** arena::grid (int T) {
+  // writing the table into the arena would fault in the page under it, and
+  // the first rows of the grid with it, on the constructing thread
+  this->tables.emplace_back(new double*[T+1]);
+
+  double** rows = this->tables.back().get();
+  char*    data = static_cast<char*>(this->allocate((T+1) * row_stride(T)));
+
+  for (int i = 0; i < T+1; ++i) {
+    rows[i] = reinterpret_cast<double*>(data + i * row_stride(T));
+  }
+  return rows;
+}
+
+arena::arena (size_t bytes)
+  : mapping(nullptr), mapped(0), base(nullptr), capacity(0), used(0), huge_pages(false)
+{
+  // leave room for the alignment of every allocation
+  bytes = round_up(bytes + 16 * CACHE_LINE, HUGE_PAGE);
+
+#ifdef MAP_HUGETLB
+  // explicit huge pages only exist if the administrator reserved them,
+  // otherwise this fails straight away
+  void* huge = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (huge != MAP_FAILED) {
+    this->mapping    = this->base = static_cast<char*>(huge);
+    this->mapped     = this->capacity = bytes;
+    this->huge_pages = true;
+    return;
+  }
+#endif
+
+  // transparent huge pages only back 2 MB aligned ranges, so over-map and align
+  void* memory = mmap(nullptr, bytes + HUGE_PAGE, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) throw std::bad_alloc();
+
+  this->mapping  = static_cast<char*>(memory);
+  this->mapped   = bytes + HUGE_PAGE;
+  this->base     = this->mapping + (round_up((size_t) this->mapping, HUGE_PAGE) - (size_t) this->mapping);
+  this->capacity = bytes;
+
+#ifdef MADV_HUGEPAGE
+  this->huge_pages = madvise(this->base, this->capacity, MADV_HUGEPAGE) == 0;
+#endif
+}
+
+arena::~arena () {
+  munmap(this->mapping, this->mapped);
+}
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cmath>
+
+#include "emitter.hpp"
+
+namespace {
+  // a gaussian falls to exp(-2) ~ 0.14 at the edge of the shape
+  const double GAUSSIAN_SHARPNESS = 2.0;
+}
+
+emitter* emitter::set_position (float x, float y) noexcept {
+  this->x = x;
+  this->y = y;
+  return this;
+}
+
+emitter* emitter::set_shape (shape form, float width, float height) noexcept {
+  this->form   = form;
+  this->width  = width;
+  this->height = height;
+  return this;
+}
+
+emitter* emitter::set_falloff (falloff profile) noexcept {
+  this->profile = profile;
+  return this;
+}
+
+emitter* emitter::set_density (double rate) noexcept {
+  this->density = rate;
+  return this;
+}
+
+emitter* emitter::set_velocity (double vx, double vy, mode mx, mode my) noexcept {
+  this->velocity_x = vx;
+  this->velocity_y = vy;
+  this->mode_x     = mx;
+  this->mode_y     = my;
+  return this;
+}
+
+emitter* emitter::set_enabled (bool enabled) noexcept {
+  this->enabled = enabled;
+  return this;
+}
+
+bool emitter::rasterize (int T, fluid::source* out) const noexcept {
+  if (!this->enabled) return false;
+
+  fluid::source& s = *out;
+
+  if (this->form == shape::point) {
+    // the single cell containing the emitter
+    s.i0 = (int) std::floor(this->x * T);
+    s.j0 = (int) std::floor(this->y * T);
+    s.i1 = s.i0 + 1;
+    s.j1 = s.j0 + 1;
+    s.cx = s.i0 + 0.5;
+    s.cy = s.j0 + 0.5;
+    s.rx = s.ry = 0.5;
+  } else {
+    s.cx = this->x * T;
+    s.cy = this->y * T;
+    s.rx = std::max(0.5, this->width  * T / 2.0);
+    s.ry = std::max(0.5, this->height * T / 2.0);
+    s.i0 = (int) std::floor(s.cx - s.rx);
+    s.i1 = (int) std::ceil (s.cx + s.rx);
+    s.j0 = (int) std::floor(s.cy - s.ry);
+    s.j1 = (int) std::ceil (s.cy + s.ry);
+  }
+
+  if (s.i1 <= 0 || s.j1 <= 0 || s.i0 >= T || s.j0 >= T) return false;
+
+  s.round     = this->form == shape::disc;
+  s.sharpness = this->profile == falloff::gaussian ? GAUSSIAN_SHARPNESS : 0.0;
+
+  s.value[fluid::DENSITY]    = this->density;
+  s.value[fluid::VELOCITY_X] = this->velocity_x;
+  s.value[fluid::VELOCITY_Y] = this->velocity_y;
+  s.set  [fluid::DENSITY]    = false;
+  s.set  [fluid::VELOCITY_X] = this->mode_x == mode::set;
+  s.set  [fluid::VELOCITY_Y] = this->mode_y == mode::set;
+  return true;
+}
+
+emitter::emitter (float x, float y)
+  : form       (shape::point),
+    profile    (falloff::uniform),
+    x          (x),
+    y          (y),
+    width      (0),
+    height     (0),
+    density    (0),
+    velocity_x (0),
+    velocity_y (0),
+    mode_x     (mode::add),
+    mode_y     (mode::add),
+    enabled    (true)
+{}
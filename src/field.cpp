@@ -0,0 +1,116 @@
+#include <algorithm>
+
+#include "field.hpp"
+
+namespace {
+  // past this many overrides a dense grid is both smaller and faster to sweep
+  inline size_t sparse_limit (int T) { return (size_t) (T+1) * (T+1) / 8; }
+
+  template <class List>
+  auto find_override (List& overrides, int index) -> decltype(overrides.begin()) {
+    return std::lower_bound(
+        overrides.begin(), overrides.end(), index,
+        [] (const std::pair<int, double>& o, int index) { return o.first < index; });
+  }
+}
+
+double** field::get_rows () noexcept {
+  return this->mode == storage::dense ? this->rows.data() : nullptr;
+}
+
+const double* const* field::get_rows () const noexcept {
+  return this->mode == storage::dense ? this->rows.data() : nullptr;
+}
+
+double field::at (int i, int j) const noexcept {
+  const int index = i * (this->T+1) + j;
+  switch (this->mode) {
+    case storage::dense:
+      return this->cells[index];
+
+    case storage::sparse: {
+      auto it = find_override(this->overrides, index);
+      return it != this->overrides.end() && it->first == index ? it->second : this->base;
+    }
+
+    default:
+      return this->base;
+  }
+}
+
+void field::densify () {
+  if (this->mode == storage::dense) return;
+
+  this->cells.assign((size_t) (this->T+1) * (this->T+1), this->base);
+  this->rows.resize(this->T+1);
+  for (int i = 0; i < this->T+1; ++i) {
+    this->rows[i] = &this->cells[(size_t) i * (this->T+1)];
+  }
+  for (const auto& o : this->overrides) {
+    this->cells[o.first] = o.second;
+  }
+
+  this->overrides.clear();
+  this->overrides.shrink_to_fit();
+  this->mode = storage::dense;
+}
+
+double** field::to_dense () {
+  this->densify();
+  return this->rows.data();
+}
+
+field* field::set_uniform (double value) {
+  this->mode = storage::uniform;
+  this->base = value;
+
+  this->overrides.clear();
+  this->cells.clear();
+  this->cells.shrink_to_fit();
+  this->rows.clear();
+  this->rows.shrink_to_fit();
+  return this;
+}
+
+field* field::set (int i, int j, double value) {
+  const int index = i * (this->T+1) + j;
+
+  if (this->mode == storage::dense) {
+    this->cells[index] = value;
+    return this;
+  }
+
+  auto it = find_override(this->overrides, index);
+
+  if (it != this->overrides.end() && it->first == index) {
+    it->second = value;
+  } else if (value != this->base) {
+    this->overrides.emplace(it, index, value);
+    this->mode = storage::sparse;
+    if (this->overrides.size() > sparse_limit(this->T)) this->densify();
+  }
+  return this;
+}
+
+field::field (int T, double value) : T(T), mode(storage::uniform), base(value) {}
+
+field::field (const field& f) : T(f.T), mode(storage::uniform), base(0.0) {
+  *this = f;
+}
+
+field& field::operator= (const field& f) {
+  // only fields of the same size may be assigned, T is fixed at construction
+  this->mode      = f.mode;
+  this->base      = f.base;
+  this->overrides = f.overrides;
+  this->cells     = f.cells;
+
+  this->rows.clear();
+  if (this->mode == storage::dense) {
+    this->rows.resize(this->T+1);
+    for (int i = 0; i < this->T+1; ++i) {
+      this->rows[i] = &this->cells[(size_t) i * (this->T+1)];
+    }
+  }
+  return *this;
+}
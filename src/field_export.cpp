@@ -0,0 +1,166 @@
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "field_export.hpp"
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory atomics must be lock-free");
+
+namespace {
+
+  inline size_t round_up (size_t n, size_t multiple) {
+    return (n + multiple - 1) / multiple * multiple;
+  }
+
+  // paths of the live objects, so a SIGINT or SIGTERM does not leave them
+  // behind in /dev/shm; only async-signal-safe state is touched by the handler
+  const int    MAX_EXPORTS = 8;
+  const size_t MAX_PATH    = 256;
+
+  char                  live_paths[MAX_EXPORTS][MAX_PATH];
+  volatile sig_atomic_t live[MAX_EXPORTS];
+
+  struct sigaction previous_int, previous_term;
+
+  void unlink_on_signal (int signal) {
+    for (int k = 0; k < MAX_EXPORTS; ++k) {
+      if (live[k]) shm_unlink(live_paths[k]);
+    }
+
+    // hand the signal on to whatever handled it before
+    sigaction(signal, signal == SIGINT ? &previous_int : &previous_term, nullptr);
+    raise(signal);
+  }
+
+  // -1 when the path is too long or every entry is taken
+  int track (const std::string& path) {
+    static bool installed = false;
+    if (!installed) {
+      struct sigaction action;
+      std::memset(&action, 0, sizeof(action));
+      action.sa_handler = unlink_on_signal;
+      sigemptyset(&action.sa_mask);
+      sigaction(SIGINT,  &action, &previous_int);
+      sigaction(SIGTERM, &action, &previous_term);
+      installed = true;
+    }
+
+    if (path.size() >= MAX_PATH) return -1;
+    for (int k = 0; k < MAX_EXPORTS; ++k) {
+      if (live[k]) continue;
+      std::memcpy(live_paths[k], path.c_str(), path.size() + 1);
+      live[k] = 1;
+      return k;
+    }
+    return -1;
+  }
+
+  void untrack (int entry) {
+    if (entry >= 0) live[entry] = 0;
+  }
+
+  inline shm_export::export_slot* slot_at (shm_export::export_header* header, uint64_t frame) {
+    char* base = reinterpret_cast<char*>(header);
+    return reinterpret_cast<shm_export::export_slot*>(
+        base + header->header_bytes + (frame % header->slot_count) * header->slot_bytes);
+  }
+}
+
+uint64_t shm_export::checksum (const uint64_t* data, size_t words) noexcept {
+  uint64_t a = 0, b = 0;
+  for (size_t k = 0; k < words; ++k) {
+    a += data[k];
+    b += a;
+  }
+  return a ^ b;
+}
+
+void field_export::publish (double dt, double** dens, double** vec_x, double** vec_y) noexcept {
+  using namespace shm_export;
+
+  this->frame += 1;
+  this->time  += dt;
+
+  export_slot* slot = slot_at(this->header, this->frame);
+  slot->sequence.store(2 * this->frame - 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  double* payload = reinterpret_cast<double*>(reinterpret_cast<char*>(slot) + this->header->payload_offset);
+  double** fields[FIELDS] = { dens, vec_x, vec_y };
+  for (uint32_t f = 0; f < FIELDS; ++f) {
+    for (int i = 0; i < this->T; ++i) {
+      std::memcpy(payload + ((size_t) f * this->T + i) * this->T, fields[f][i], this->T * sizeof(double));
+    }
+  }
+
+  slot->frame    = this->frame;
+  slot->time     = this->time;
+  slot->checksum = checksum(reinterpret_cast<const uint64_t*>(payload), (size_t) FIELDS * this->T * this->T);
+
+  slot->sequence.store(2 * this->frame, std::memory_order_release);
+  this->header->latest.store(this->frame, std::memory_order_release);
+}
+
+field_export::field_export (const std::string& name, int T, int slots)
+  : name(name), T(T), slots(slots), bytes(0), memory(nullptr), header(nullptr), frame(0), time(0),
+    tracked(-1)
+{
+  using namespace shm_export;
+
+  if (T < 1)     throw std::invalid_argument("field_export: grid size must be at least 1");
+  if (slots < 1) throw std::invalid_argument("field_export: slot count must be at least 1");
+
+  const size_t header_bytes   = round_up(sizeof(export_header), 64);
+  const size_t payload_offset = round_up(sizeof(export_slot), 64);
+  const size_t slot_bytes     = round_up(payload_offset + (size_t) FIELDS * T * T * sizeof(double), 64);
+  this->bytes = header_bytes + slot_bytes * slots;
+
+  const std::string path = "/" + name;
+  // replace any object left by an earlier run; readers still mapping it keep
+  // their copy instead of seeing it truncated under them
+  shm_unlink(path.c_str());
+  const int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) throw std::system_error(errno, std::generic_category(), "shm_open " + path);
+
+  if (ftruncate(fd, this->bytes) != 0) {
+    const int error = errno;
+    close(fd);
+    shm_unlink(path.c_str());
+    throw std::system_error(error, std::generic_category(), "ftruncate " + path);
+  }
+
+  this->memory = mmap(nullptr, this->bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  const int error = errno;
+  close(fd);
+  if (this->memory == MAP_FAILED) {
+    shm_unlink(path.c_str());
+    throw std::system_error(error, std::generic_category(), "mmap " + path);
+  }
+
+  // the object is new, so every slot starts zeroed (sequence 0)
+  this->header = new (this->memory) export_header();
+  std::memcpy(this->header->magic, MAGIC, sizeof(MAGIC));
+  this->header->version        = VERSION;
+  this->header->header_bytes   = header_bytes;
+  this->header->grid_size      = T;
+  this->header->field_count    = FIELDS;
+  this->header->slot_count     = slots;
+  this->header->payload_offset = payload_offset;
+  this->header->slot_bytes     = slot_bytes;
+  this->header->latest.store(0, std::memory_order_release);
+
+  this->tracked = track(path);
+}
+
+field_export::~field_export () {
+  untrack(this->tracked);
+  munmap(this->memory, this->bytes);
+  shm_unlink(("/" + this->name).c_str());
+}
@@ -1,11 +1,50 @@
 #include <iostream>
+#include <stdexcept>
+#include <string>
 #include <SDL2/SDL.h>
 
 #include "main.hpp"
 #include "sdl_exception.hpp"
 #include "main_loop.hpp"
+#include "scenario.hpp"
+
+int main(int argc, char** argv) {
+  std::string export_name;
+  std::string scenario_path;
+  bool        headless = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--export" && i + 1 < argc) {
+      export_name = argv[++i];
+    } else if ((arg == "--scenario" || arg == "--headless") && i + 1 < argc) {
+      scenario_path = argv[++i];
+      headless      = arg == "--headless";
+    } else {
+      std::cerr << "usage: " << argv[0]
+        << " [--export NAME] [--scenario FILE | --headless FILE]" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  scenario script = main_loop::default_scenario();
+  if (!scenario_path.empty()) {
+    try {
+      script = scenario::load(scenario_path);
+    } catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // run the scenario without a window
+  if (headless) {
+    main_loop m(nullptr, 800, 800, script);
+    m.init();
+    if (!export_name.empty()) m.enable_export(export_name);
+    m.run_headless();
+    return EXIT_SUCCESS;
+  }
 
-int main() {
   if (SDL_Init(SDL_INIT_VIDEO)) {
     throw sdl_exception("Could not initialize video");
     return EXIT_FAILURE;
@@ -20,9 +59,13 @@ int main() {
       0
       );
 
-  main_loop m(window, 800, 800);
-  m.init();
-  m.start();
+  // the loop releases its renderer, so it has to go before the window does
+  {
+    main_loop m(window, 800, 800, script);
+    m.init();
+    if (!export_name.empty()) m.enable_export(export_name);
+    m.start();
+  }
 
   SDL_DestroyWindow(window);
   SDL_Quit();
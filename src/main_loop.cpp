@@ -1,5 +1,7 @@
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <iomanip>
 #include <limits>
 #include <iostream>
 
@@ -40,17 +42,32 @@ namespace util {
   }
 }
 
-main_loop::main_loop(SDL_Window *window, int width, int height)
+main_loop::main_loop(SDL_Window *window, int width, int height, const scenario& script)
   : m_window_width   (width), 
     m_window_height  (height),
 
+    // the scenario falls back to the build's grid and frame time
+    m_script   (script),
+    m_sim_size (script.grid > 0 ? script.grid : SIM_SIZE),
+    m_dt       (script.dt   > 0 ? script.dt   : DT),
+
+    m_renderer (nullptr),
+    m_texture  (nullptr),
+
     // init object list
     objs  (),
 
     // init smoke simulator
-    smoke (new smoke_sim(SIM_SIZE))
+    smoke (new smoke_sim(m_sim_size)),
+    exhausts (),
+
+    // init display
+    display (window ? new upscaler(m_sim_size, width, height, *smoke->get_workers()) : nullptr)
 
 {
+  // headless
+  if (window == nullptr) return;
+
   m_renderer = SDL_CreateRenderer(
       window,
       -1,
@@ -59,6 +76,17 @@ main_loop::main_loop(SDL_Window *window, int width, int height)
 
   if (m_renderer == nullptr) throw sdl_exception("Could not create renderer");
   SDL_SetRenderDrawBlendMode(m_renderer, SDL_BLENDMODE_BLEND);
+
+  m_texture = SDL_CreateTexture(
+      m_renderer,
+      SDL_PIXELFORMAT_ARGB8888,
+      SDL_TEXTUREACCESS_STREAMING,
+      width,
+      height
+      );
+
+  if (m_texture == nullptr) throw sdl_exception("Could not create texture");
+  SDL_SetTextureBlendMode(m_texture, SDL_BLENDMODE_BLEND);
 }
 
 void main_loop::clean_up() {
@@ -67,9 +95,22 @@ void main_loop::clean_up() {
     delete obj;
   }
 
+  delete this->display;
   delete this->smoke;
 
-  SDL_DestroyRenderer(m_renderer);
+  this->objs.clear();
+  this->exhausts.clear();
+  this->display = nullptr;
+  this->smoke   = nullptr;
+
+  if (m_texture  != nullptr) SDL_DestroyTexture(m_texture);
+  if (m_renderer != nullptr) SDL_DestroyRenderer(m_renderer);
+  m_texture  = nullptr;
+  m_renderer = nullptr;
+}
+
+main_loop::~main_loop() {
+  this->clean_up();
 }
 
 void main_loop::keydown_callback(const SDL_Scancode scancode) {
@@ -84,57 +125,228 @@ void main_loop::keydown_callback(const SDL_Scancode scancode) {
       break;
 
     case SDL_SCANCODE_R:
-      if (objs.size() > 0) {
-        model::rocket* rock = dynamic_cast<model::rocket*> (this->objs[0]);
-        rock->set_position(0.5f, 1.0f);
-        this->smoke->reset();
-      }
+      this->reset();
       break;
 
     case SDL_SCANCODE_SPACE:
       m_show_pressure = !m_show_pressure;
       break;
 
+    case SDL_SCANCODE_U:
+      m_upscale = !m_upscale;
+      break;
+
+    case SDL_SCANCODE_D:
+      m_detail = !m_detail;
+      this->display->set_detail(m_detail);
+      break;
+
+    case SDL_SCANCODE_A:
+      m_adi = !m_adi;
+      this->smoke->set_diffuse_solver(m_adi ?
+          smoke_sim::diffuse_solver::adi : smoke_sim::diffuse_solver::gauss_seidel);
+      break;
+
+    case SDL_SCANCODE_T:
+      for (const task_graph::stage_timing& t : this->smoke->get_stage_timings()) {
+        std::cout
+          << t.name << ": "
+          << t.start_ms << " - " << t.end_ms << " ms"
+          << " (busy " << t.busy_ms << " ms)" << std::endl;
+      }
+      this->print_solves();
+      break;
+
     default:
       // Do nothing
       break;
   }
 }
 
+scenario main_loop::default_scenario() {
+  scenario s;
+
+  // one rocket at the bottom, with the default trajectory and exhaust
+  scenario::rocket_spec rocket;
+  rocket.x    = 0.5;
+  rocket.y    = 1.0;
+  rocket.size = 50;
+  s.rockets.push_back(rocket);
+
+  // start paused and let the solvers give up early to hold the frame rate
+  s.events.push_back({ 0, scenario::action::pause });
+  s.budget = FRAME_BUDGET;
+  return s;
+}
+
 void main_loop::init() {
 
-  // pause the simulation
-  this->m_pause = true;
-  
-  // create a rocket
-  object* obj = dynamic_cast<object*> (new model::rocket(0.5, 1.0, 50, this->m_renderer));
-  this->objs.emplace_back(obj);
+  const scenario& script = this->m_script;
+
+  // rates of the scenario are per frame, those of the emitters per unit of time
+  const double step = this->m_dt / 100.0;
+
+  // create the rockets, each with its engine's smoke
+  for (const scenario::rocket_spec& r : script.rockets) {
+    model::rocket* rock = new model::rocket(r.x, r.y, r.size, this->m_renderer);
+    rock->set_velocity(r.vx, r.vy);
+    this->objs.emplace_back(dynamic_cast<object*> (rock));
+
+    this->exhausts.emplace_back(this->smoke->add_emitter(r.x, r.y)
+      ->set_density  (r.exhaust_density / step)
+      ->set_velocity (0, r.exhaust_speed / step, emitter::mode::set, emitter::mode::add));
+  }
+
+  // fixed emitters
+  for (const scenario::emitter_spec& e : script.emitters) {
+    this->smoke->add_emitter(e.x, e.y)
+      ->set_shape    (e.form, e.width, e.height)
+      ->set_falloff  (e.profile)
+      ->set_density  (e.density / step)
+      ->set_velocity (
+          e.mode_x == emitter::mode::add ? e.vx / step : e.vx,
+          e.mode_y == emitter::mode::add ? e.vy / step : e.vy,
+          e.mode_x,
+          e.mode_y);
+  }
 
   // set fluid configuration
   this->smoke
-    ->set_diffuse   (5)
-    ->set_viscosity (1)
-    ->set_density   (0.001);
+    ->set_diffuse   (script.diffuse)
+    ->set_viscosity (script.viscosity)
+    ->set_density   (script.density)
+    ->set_diffuse_solver (script.solver)
+    ->set_frame_budget   (script.budget);
+  this->m_adi = script.solver == smoke_sim::diffuse_solver::adi;
 
   // set pressure
-  for (int i = 0; i <= (int) SIM_SIZE; ++i) {
-    for (int j = 0; j <= (int) SIM_SIZE; ++j) {
+  for (int i = 0; i <= m_sim_size; ++i) {
+    for (int j = 0; j <= m_sim_size; ++j) {
       this->smoke->get_pressure()[i][j] = 0.0f;
     }
   }
   
-  // set gravity
-  for (int i = 0; i <= (int) SIM_SIZE; ++i) {
-    for (int j = 0; j <= (int) SIM_SIZE; ++j) {
+  // set velocity
+  for (int i = 0; i <= m_sim_size; ++i) {
+    for (int j = 0; j <= m_sim_size; ++j) {
       this->smoke->get_vec_x()[i][j]    = 0;
       this->smoke->get_vec_y()[i][j]    = 0;
+    }
+  }
 
-      this->smoke->get_force_x()[i][j]  = 0.0;
-      this->smoke->get_force_y()[i][j]  = 0.3;
+  // set gravity
+  this->smoke->get_force_x()->set_uniform(script.gravity_x);
+  this->smoke->get_force_y()->set_uniform(script.gravity_y);
+}
+
+void main_loop::reset() {
+  for (size_t k = 0; k < this->objs.size(); ++k) {
+    model::rocket* rock = dynamic_cast<model::rocket*> (this->objs[k]);
+    rock->set_position(this->m_script.rockets[k].x, this->m_script.rockets[k].y);
+  }
+  this->smoke->reset();
+}
+
+void main_loop::play_events() {
+  const std::vector<scenario::event>& events = this->m_script.events;
+
+  for (; m_next_event < events.size() && events[m_next_event].frame <= m_frame; ++m_next_event) {
+    switch (events[m_next_event].what) {
+      case scenario::action::pause:
+        m_pause = true;
+        break;
+
+      case scenario::action::resume:
+        m_pause = false;
+        break;
+
+      case scenario::action::reset:
+        this->reset();
+        break;
+
+      case scenario::action::pressure:
+        m_show_pressure = !m_show_pressure;
+        break;
+
+      case scenario::action::upscale:
+        m_upscale = !m_upscale;
+        break;
+
+      case scenario::action::detail:
+        m_detail = !m_detail;
+        if (this->display) this->display->set_detail(m_detail);
+        break;
+
+      case scenario::action::gauss_seidel:
+      case scenario::action::adi:
+        m_adi = events[m_next_event].what == scenario::action::adi;
+        this->smoke->set_diffuse_solver(m_adi ?
+            smoke_sim::diffuse_solver::adi : smoke_sim::diffuse_solver::gauss_seidel);
+        break;
+
+      case scenario::action::end:
+        m_continue_loop = false;
+        break;
     }
   }
 }
 
+void main_loop::print_solves() const {
+  const smoke_sim::solve_report& report = this->smoke->get_solve_report();
+
+  // sweeps completed out of those asked for; an ADI diffusion has no sweeps
+  // to cut short, so it is only named
+  const auto sweeps = [&report] (int done) {
+    return std::to_string(done) + "/" + std::to_string(report.iterations);
+  };
+  const auto diffusion = [this, &sweeps] (int done) {
+    return m_adi ? std::string("adi") : sweeps(done);
+  };
+
+  std::cout
+    << "solves of the last step (" << report.elapsed_ms << " ms):"
+    << " viscosity x "  << diffusion(report.viscosity_x)
+    << ", viscosity y " << diffusion(report.viscosity_y)
+    << ", pressure "    << sweeps(report.pressure)
+    << ", density "     << diffusion(report.diffusion)
+    << std::endl;
+}
+
+void main_loop::print_checksum() const {
+  std::cout
+    << "frame " << m_frame << ", checksum "
+    << std::hex << std::setw(16) << std::setfill('0') << this->smoke->get_checksum()
+    << std::dec << std::setfill(' ') << std::endl;
+}
+
+void main_loop::enable_export(const std::string& name) {
+  this->smoke->enable_export(name);
+}
+
+void main_loop::step(double dt) {
+
+  // move the exhausts with their rockets
+  for (size_t k = 0; k < this->objs.size(); ++k) {
+    model::rocket* rock = dynamic_cast<model::rocket*> (this->objs[k]);
+
+    this->exhausts[k]
+      ->set_position (rock->get_x(), rock->get_y())
+      ->set_enabled  (rock->get_smoke_position(m_sim_size).second > 0);
+  }
+
+  // simulate smoke, animating the objects alongside
+  this->smoke->simulate(dt / 100.0, [this, dt] {
+      for (object* obj : this->objs) {
+        obj->simulate(dt / 100.0);
+      }
+    });
+
+  // carry the sub-grid detail along with the smoke
+  if (this->display) {
+    this->display->advect_detail(this->smoke->get_vec_x(), this->smoke->get_vec_y(), dt / 100.0);
+  }
+}
+
 void main_loop::draw(double dt) {
 
   static const int R = 0xBB;
@@ -142,52 +354,33 @@ void main_loop::draw(double dt) {
   static const int B = 0xBB;
 
   // simulate the model
-  if (!m_pause) {
-
-    // add smoke from the rocket
-    model::rocket* rock = dynamic_cast<model::rocket*> (this->objs[0]);
-
-    std::pair<int, int> pos = rock->get_smoke_position(SIM_SIZE);
-
-    if (pos.second > 0) {
-      this->smoke->get_dens()
-        [pos.first]
-        [pos.second] += 25;
-      this->smoke->get_vec_x()
-        [pos.first]
-        [pos.second] = 0;
-      this->smoke->get_vec_x()
-        [pos.first+1]
-        [pos.second] = 0;
-      this->smoke->get_vec_y()
-        [pos.first]
-        [pos.second] += 300;
-      this->smoke->get_vec_y()
-        [pos.first+1]
-        [pos.second] += 300;
-    }
+  if (!m_pause) this->step(dt);
+
+  // render the smoke at window resolution
+  if (this->m_upscale && !this->m_show_pressure) {
+    const uint32_t* pixels = this->display->render(this->smoke->get_dens(), R, G, B);
+
+    SDL_UpdateTexture (this->m_texture, nullptr, pixels, this->m_window_width * sizeof(uint32_t));
+    SDL_RenderCopy    (this->m_renderer, this->m_texture, nullptr, nullptr);
 
-    // animate objects
     for (object* obj : this->objs) {
-      obj->simulate(dt / 100.0);
+      obj->draw(m_window_width, m_window_height, this->m_renderer);
     }
-
-    // simulate smoke
-    this->smoke->simulate(dt / 100.0);
+    return;
   }
 
-  // render the smoke
-  const size_t  size_x = this->m_window_width  / SIM_SIZE;
-  const size_t  pad_x  = this->m_window_width  % SIM_SIZE; 
-  const size_t  size_y = this->m_window_height / SIM_SIZE; 
-  const size_t  pad_y  = this->m_window_height % SIM_SIZE;
+  // render the smoke, one block per cell
+  const size_t  size_x = this->m_window_width  / m_sim_size;
+  const size_t  pad_x  = this->m_window_width  % m_sim_size; 
+  const size_t  size_y = this->m_window_height / m_sim_size; 
+  const size_t  pad_y  = this->m_window_height % m_sim_size;
 
   uint8_t r, g, b;
   static double min_p = std::numeric_limits<double>::max();
   static double max_p = std::numeric_limits<double>::min();
 
-  for (size_t i = 0; i < SIM_SIZE; ++i) {
-    for (size_t j = 0; j < SIM_SIZE; ++j) {
+  for (size_t i = 0; i < (size_t) m_sim_size; ++i) {
+    for (size_t j = 0; j < (size_t) m_sim_size; ++j) {
 
       const int x = i * size_x + std::min(i, pad_x);
       const int y = j * size_y + std::min(j, pad_y);
@@ -224,6 +417,10 @@ void main_loop::start() {
   m_loop_tick_start = SDL_GetTicks();
 
   while (m_continue_loop) {
+
+    // Play the scenario
+    this->play_events();
+    if (!m_continue_loop) break;
  
     // Process events
     SDL_Event event;
@@ -234,6 +431,10 @@ void main_loop::start() {
         case SDL_KEYDOWN:
           keydown_callback(event.key.keysym.scancode);
           break;
+
+        case SDL_QUIT:
+          m_continue_loop = false;
+          break;
       }
     }
 
@@ -241,10 +442,37 @@ void main_loop::start() {
     SDL_SetRenderDrawColor  (this->m_renderer, 0x00, 0x00, 0x00, 0xFF);
     SDL_RenderClear         (m_renderer);
 
-    this->draw              (DT);
+    this->draw              (m_dt);
 
     SDL_RenderPresent       (m_renderer);
 
     m_loop_tick_start = SDL_GetTicks();
+    ++m_frame;
   }
+
+  this->print_checksum();
+}
+
+void main_loop::run_headless() {
+
+  using clock = std::chrono::steady_clock;
+  const clock::time_point start = clock::now();
+
+  int steps = 0;
+  for (; m_frame < m_script.frames; ++m_frame) {
+    this->play_events();
+    if (!m_continue_loop) break;
+
+    if (!m_pause) {
+      this->step(m_dt);
+      ++steps;
+    }
+  }
+
+  const double elapsed = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+  std::cout
+    << steps << " steps in " << elapsed << " ms"
+    << " (" << (steps > 0 ? elapsed / steps : 0.0) << " ms/step)" << std::endl;
+  if (steps > 0) this->print_solves();
+  this->print_checksum();
 }
@@ -52,7 +52,8 @@ namespace model {
   }
 
   void rocket::simulate (float dt) {
-    this->y -= dt / 100;
+    this->x += this->vx * dt;
+    this->y += this->vy * dt;
   }
 
   std::pair<int, int> rocket::get_smoke_position (int T) const noexcept {
@@ -65,7 +66,16 @@ namespace model {
     return this;
   }
 
-  rocket::rocket  (float x, float y, int s, SDL_Renderer *renderer) : img(nullptr), x(x), y(y), s(s) {
+  rocket* rocket::set_velocity (float vx, float vy) {
+    this->vx = vx;
+    this->vy = vy;
+    return this;
+  }
+
+  rocket::rocket  (float x, float y, int s, SDL_Renderer *renderer)
+    : img(nullptr), x(x), y(y), vx(0.0f), vy(-0.01f), t(0.0f), ratio(1.0f), s(s) {
+    if (renderer == nullptr) return;
+
     this->img = IMG_LoadTexture(renderer, "./rocket.png");
 
     int w, h;
@@ -75,6 +85,6 @@ namespace model {
   }
 
   void rocket::cleanup () {
-    SDL_DestroyTexture(this->img);
+    if (this->img != nullptr) SDL_DestroyTexture(this->img);
   }
 }
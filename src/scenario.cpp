@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "scenario.hpp"
+
+namespace {
+
+  class line_error : public std::runtime_error {
+    public:
+      explicit line_error (const std::string& message) : std::runtime_error(message) {}
+  };
+
+  // read one value of the directive `name`, which must be there
+  template <typename T>
+  T value (std::istringstream& in, const std::string& name) {
+    T v;
+    if (!(in >> v)) throw line_error("expected a value after '" + name + "'");
+    return v;
+  }
+
+  emitter::mode parse_mode (const std::string& word) {
+    if (word == "add") return emitter::mode::add;
+    if (word == "set") return emitter::mode::set;
+    throw line_error("unknown velocity mode '" + word + "'");
+  }
+
+  smoke_sim::diffuse_solver parse_solver (const std::string& word) {
+    if (word == "gauss_seidel") return smoke_sim::diffuse_solver::gauss_seidel;
+    if (word == "adi")          return smoke_sim::diffuse_solver::adi;
+    throw line_error("unknown solver '" + word + "'");
+  }
+
+  scenario::action parse_action (const std::string& word) {
+    static const std::pair<const char*, scenario::action> ACTIONS[] = {
+      { "pause",        scenario::action::pause        },
+      { "resume",       scenario::action::resume       },
+      { "reset",        scenario::action::reset        },
+      { "pressure",     scenario::action::pressure     },
+      { "upscale",      scenario::action::upscale      },
+      { "detail",       scenario::action::detail       },
+      { "gauss_seidel", scenario::action::gauss_seidel },
+      { "adi",          scenario::action::adi          },
+      { "end",          scenario::action::end          },
+    };
+    for (const auto& a : ACTIONS) {
+      if (word == a.first) return a.second;
+    }
+    throw line_error("unknown action '" + word + "'");
+  }
+
+  scenario::rocket_spec parse_rocket (std::istringstream& in) {
+    scenario::rocket_spec r;
+    r.x    = value<float> (in, "rocket");
+    r.y    = value<float> (in, "rocket");
+    r.size = value<int>   (in, "rocket");
+    if (r.size <= 0) throw line_error("rocket size must be positive");
+
+    std::string option;
+    while (in >> option) {
+      if (option == "velocity") {
+        r.vx = value<float> (in, option);
+        r.vy = value<float> (in, option);
+      } else if (option == "exhaust") {
+        r.exhaust_density = value<double> (in, option);
+        r.exhaust_speed   = value<double> (in, option);
+      } else {
+        throw line_error("unknown rocket option '" + option + "'");
+      }
+    }
+    return r;
+  }
+
+  scenario::emitter_spec parse_emitter (std::istringstream& in) {
+    scenario::emitter_spec e;
+    e.x = value<float> (in, "emitter");
+    e.y = value<float> (in, "emitter");
+
+    std::string option;
+    while (in >> option) {
+      if (option == "disc" || option == "box") {
+        e.form   = option == "disc" ? emitter::shape::disc : emitter::shape::box;
+        e.width  = value<float> (in, option);
+        e.height = value<float> (in, option);
+      } else if (option == "gaussian") {
+        e.profile = emitter::falloff::gaussian;
+      } else if (option == "density") {
+        e.density = value<double> (in, option);
+      } else if (option == "velocity") {
+        e.vx = value<double> (in, option);
+        e.vy = value<double> (in, option);
+
+        // the modes are optional, and only ever followed by another option
+        std::string mode;
+        for (emitter::mode* m : { &e.mode_x, &e.mode_y }) {
+          const std::streampos before = in.tellg();
+          if (!(in >> mode)) break;
+          if (mode != "add" && mode != "set") {
+            in.seekg(before);
+            break;
+          }
+          *m = parse_mode(mode);
+        }
+      } else {
+        throw line_error("unknown emitter option '" + option + "'");
+      }
+    }
+    return e;
+  }
+
+  void parse_line (const std::string& directive, std::istringstream& in, scenario* s) {
+    if (directive == "grid") {
+      s->grid = value<int> (in, directive);
+      if (s->grid < 8) throw line_error("grid must be at least 8");
+    } else if (directive == "dt") {
+      s->dt = value<double> (in, directive);
+      if (!(s->dt > 0)) throw line_error("dt must be positive");
+    } else if (directive == "frames") {
+      s->frames = value<int> (in, directive);
+      if (s->frames < 0) throw line_error("frames must not be negative");
+    } else if (directive == "budget") {
+      s->budget = value<double> (in, directive);
+      if (!(s->budget >= 0)) throw line_error("budget must not be negative");
+    } else if (directive == "diffuse") {
+      s->diffuse = value<double> (in, directive);
+    } else if (directive == "viscosity") {
+      s->viscosity = value<double> (in, directive);
+    } else if (directive == "density") {
+      s->density = value<double> (in, directive);
+    } else if (directive == "gravity") {
+      s->gravity_x = value<double> (in, directive);
+      s->gravity_y = value<double> (in, directive);
+    } else if (directive == "solver") {
+      s->solver = parse_solver(value<std::string> (in, directive));
+    } else if (directive == "rocket") {
+      s->rockets.push_back(parse_rocket(in));
+    } else if (directive == "emitter") {
+      s->emitters.push_back(parse_emitter(in));
+    } else if (directive == "at") {
+      scenario::event e;
+      e.frame = value<int> (in, directive);
+      std::string word;
+      if (!(in >> word)) throw line_error("expected an action after 'at'");
+      e.what = parse_action(word);
+      s->events.push_back(e);
+    } else {
+      throw line_error("unknown directive '" + directive + "'");
+    }
+
+    std::string rest;
+    if (in >> rest) throw line_error("unexpected '" + rest + "'");
+  }
+}
+
+scenario scenario::load (const std::string& path) {
+  std::ifstream file(path);
+  if (!file) throw std::runtime_error("Could not open scenario " + path);
+
+  scenario s;
+  std::string line;
+  for (int number = 1; std::getline(file, line); ++number) {
+    line = line.substr(0, line.find('#'));
+
+    std::istringstream in(line);
+    std::string directive;
+    if (!(in >> directive)) continue;
+
+    try {
+      parse_line(directive, in, &s);
+    } catch (const line_error& e) {
+      throw std::runtime_error(path + ":" + std::to_string(number) + ": " + e.what());
+    }
+  }
+
+  // events of the same frame keep their file order
+  std::stable_sort(s.events.begin(), s.events.end(),
+      [] (const event& a, const event& b) { return a.frame < b.frame; });
+  return s;
+}
@@ -1,126 +1,38 @@
-#include <cmath>
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 
 #include "smoke_sim.hpp"
-
-namespace std {
-  template <class T>
-  constexpr const T& clamp(const T& v, const T& lo, const T& hi) {
-    return std::min<T>(hi, std::max<T>(lo, v));
-  }
-}
-
-namespace fluid {
-
-  static const double MAX_VELOCITY = 5000000.0;
-
-  inline double trace_position (double T, double cx, double v, double dt) {
-    double x = cx + v * dt;
-    while (0 > x || x > T) {
-      if (0 > x) x = - x;
-      if (x > T) x = 2 * T - x;
-    }
-    return x;
-  }
-
-  inline bool valid(int T, int i) { return 0 < i && i < T; }
-
-  // fluid advection
-  void advect (int T, double** x, double** x0, double** u, double** v, double dt) {
-
-    for (int i = 0; i < T; ++i) {
-      for (int j = 0; j < T; ++j) {
-        double cx = i + 0.5, cy = j + 0.5;
-        
-        double cu = (u[i][j] + u[i+1][j]) / 2.0;
-        double cv = (v[i][j] + v[i][j+1]) / 2.0;
-
-        double px = trace_position (T, cx, cu, -dt);
-        double py = trace_position (T, cy, cv, -dt);
-
-        int i0   = (int) floor(px - 0.5f);
-        int i1   = i0 + 1;
-        int j0   = (int) floor(py - 0.5f);
-        int j1   = j0 + 1;
-
-        double s1 =   px - i0 - 0.5;
-        double s0 = 1.0 - s1;
-        double t1 =   py - j0 - 0.5;
-        double t0 = 1.0 - t1;
-
-        x[i][j]  =  (valid(T, i0) && valid(T, j0) ? s0 * t0 * x0[i0][j0] : 0.0) 
-                  + (valid(T, i0) && valid(T, j1) ? s0 * t1 * x0[i0][j1] : 0.0)
-                  + (valid(T, i1) && valid(T, j0) ? s1 * t0 * x0[i1][j0] : 0.0)
-                  + (valid(T, i1) && valid(T, j1) ? s1 * t1 * x0[i1][j1] : 0.0);
-      }
-    }
-  }
-
-  void diffuse (int T, double** x, double** x0, double k, double dt) {
-    static const int iteration = 20;
-
-    const double coef = k * dt;
-    for (int it = 0; it < iteration; ++it) {
-      for (int i = 0; i < T; ++i) {
-        for (int j = 0; j < T; ++j) {
-          const int bound = (i == 0) + (i+1 == T) + (j == 0) + (j+1 == T);
-          x[i][j] = (x0[i][j] + coef * (
-                (i   > 0 ? x[i-1][j] : 0.0) +
-                (i+1 < T ? x[i+1][j] : 0.0) +
-                (j   > 0 ? x[i][j-1] : 0.0) +
-                (j+1 < T ? x[i][j+1] : 0.0)
-                )) / (coef * (4 - bound) + 1);
-        }
-      }
-    }
-  }
-
-  void pressure(int T, double** p, double** w_x, double** w_y, double** w_x0, double** w_y0, double density) {
-    // calculate gradient of scalar field p using Gauss-Seidel method
-    static const int iteration = 20;
-
-    for (int it = 0; it < iteration; ++it) {
-      for (int i = 0; i < T; ++i) {
-        for (int j = 0; j < T; ++j) {
-          // Neumann boundary condition will transform each affected neighbour to p[i][j]
-          const double div_w = (w_x0[i+1][j] - w_x0[i][j]) + (w_y0[i][j+1] - w_y0[i][j]);
-          const int bound = (i == 0) + (i+1 == T) + (j == 0) + (j+1 == T);
-          p[i][j] = (density * div_w - (
-                (i   > 0 ? p[i-1][j] : 0.0) +
-                (i+1 < T ? p[i+1][j] : 0.0) +
-                (j   > 0 ? p[i][j-1] : 0.0) +
-                (j+1 < T ? p[i][j+1] : 0.0)
-                )) / (bound - 4);
-        }
-      }
-    }
-
-    for (int i = 0; i < T; ++i) {
-      for (int j = 0; j < T; ++j) {
-        // update velocity field according to Helmholtz-Hodge decomposition
-        const double grad_x = (i+1 == T) ? 0 : p[i+1][j] - p[i][j];
-        const double grad_y = (j+1 == T) ? 0 : p[i][j+1] - p[i][j];
-        w_x[i][j] = std::clamp(w_x0[i][j] - grad_x / density, -MAX_VELOCITY, MAX_VELOCITY);
-        w_y[i][j] = std::clamp(w_y0[i][j] - grad_y / density, -MAX_VELOCITY, MAX_VELOCITY);
-      }
+#include "fluid.hpp"
+
+namespace {
+
+  // share of the frame budget by which each solve should be finished.
+  // the two viscosity solves run side by side and share one deadline; the
+  // pressure and density solves wait for them, so a viscosity that
+  // finishes early leaves its slack to those. the gaps before the velocity
+  // and density solves are reserved for the advection and body force
+  // stages, which cannot be cut short
+  const double VISCOSITY_SOLVED   = 0.50;
+  // on a single thread they can only run in turn, and x finishes by this
+  const double VISCOSITY_X_ALONE  = 0.30;
+  const double PRESSURE_SOLVED    = 0.80;
+  const double DIFFUSION_SOLVED   = 1.00;
+
+  // doubles per cache line; arena rows start on a line
+  const int    COLUMNS_PER_LINE   = 8;
+
+  const int    SOLVER_ITERATIONS  = 20;
+
+  fluid::solve_limit limit_until (fluid::solve_clock::time_point start, double budget_ms, double share) {
+    fluid::solve_limit limit;
+    limit.iterations = SOLVER_ITERATIONS;
+    if (budget_ms > 0) {
+      limit.deadline = start + std::chrono::duration_cast<fluid::solve_clock::duration>(
+          std::chrono::duration<double, std::milli>(budget_ms * share));
     }
+    return limit;
   }
-
-  void body_force(
-      int T,
-      double** u,
-      double** u0,
-      double** force,
-      double dt)
-  {
-    for (int i = 0; i < T; ++i) {
-      for (int j = 0; j < T; ++j) {
-        u[i][j] = u0[i][j] + force[i][j] * dt;
-      }
-    }
-  }
-
 }
 
 double** smoke_sim::get_dens () const noexcept {
@@ -139,12 +51,21 @@ double** smoke_sim::get_vec_y () const noexcept {
   return this->vec_y;
 }
 
-double** smoke_sim::get_force_x () const noexcept {
-  return this->force_x;
+field* smoke_sim::get_force_x () noexcept {
+  return &this->force_x;
+}
+
+field* smoke_sim::get_force_y () noexcept {
+  return &this->force_y;
+}
+
+emitter* smoke_sim::add_emitter (float x, float y) {
+  this->emitters.emplace_back(x, y);
+  return &this->emitters.back();
 }
 
-double** smoke_sim::get_force_y () const noexcept {
-  return this->force_y;
+void smoke_sim::clear_emitters () noexcept {
+  this->emitters.clear();
 }
 
 std::pair<int, int> smoke_sim::get_position (float x, float y) const noexcept {
@@ -166,49 +87,195 @@ smoke_sim* smoke_sim::set_density (double density) noexcept {
   return this;
 }
 
-void smoke_sim::evolve_vec  (double dt) {
+smoke_sim* smoke_sim::set_diffuse_solver (diffuse_solver solver) noexcept {
+  this->solver = solver;
+  return this;
+}
 
-  fluid::advect     (this->T, this->tmp_vec_x, this->vec_x, this->vec_x, this->vec_y, dt);
-  fluid::advect     (this->T, this->tmp_vec_y, this->vec_y, this->vec_x, this->vec_y, dt);
-  std::swap         (this->tmp_vec_x, this->vec_x);
-  std::swap         (this->tmp_vec_y, this->vec_y);
+smoke_sim* smoke_sim::set_frame_budget (double ms) noexcept {
+  this->frame_budget = ms;
+  return this;
+}
 
-  fluid::body_force (this->T, this->tmp_vec_x, this->vec_x, this->force_x, dt);
-  fluid::body_force (this->T, this->tmp_vec_y, this->vec_y, this->force_y, dt);
-  std::swap         (this->tmp_vec_x, this->vec_x);
-  std::swap         (this->tmp_vec_y, this->vec_y);
+const smoke_sim::solve_report& smoke_sim::get_solve_report () const noexcept {
+  return this->report;
+}
 
-  fluid::diffuse    (this->T, this->tmp_vec_x, this->vec_x, this->viscosity, dt);
-  fluid::diffuse    (this->T, this->tmp_vec_y, this->vec_y, this->viscosity, dt);
-  std::swap         (this->tmp_vec_x, this->vec_x);
-  std::swap         (this->tmp_vec_y, this->vec_y);
+uint64_t smoke_sim::get_checksum () const noexcept {
+  static const uint64_t OFFSET = 0xcbf29ce484222325ull;
+  static const uint64_t PRIME  = 0x100000001b3ull;
+
+  uint64_t hash = OFFSET;
+  for (double** grid : { this->dens, this->vec_x, this->vec_y, this->pressure }) {
+    for (int i = 0; i < T+1; ++i) {
+      for (int j = 0; j < T+1; ++j) {
+        uint64_t bits;
+        std::memcpy(&bits, &grid[i][j], sizeof(bits));
+        for (int byte = 0; byte < 8; ++byte) {
+          hash ^= (bits >> (8 * byte)) & 0xff;
+          hash *= PRIME;
+        }
+      }
+    }
+  }
+  return hash;
+}
+
+smoke_sim* smoke_sim::enable_export (const std::string& name, int slots) {
+  this->exporter.reset(new field_export(name, this->T, slots));
+  return this;
+}
+
+task_graph::task_id smoke_sim::add_diffuse (
+    const std::string& name,
+    double** x,
+    double** x0,
+    double k,
+    double dt,
+    double share,
+    int* done,
+    const std::vector<task_graph::task_id>& after)
+{
+  const int T = this->T;
+
+  if (this->solver == diffuse_solver::adi) {
+    const int blocks = this->workers.get_thread_count() * 2;
+
+    // every column has to be solved before any row is. columns are handed
+    // out a cache line (8 doubles) at a time, so no two blocks write the
+    // same line of any row
+    const int lines = (T + COLUMNS_PER_LINE - 1) / COLUMNS_PER_LINE;
+    const task_graph::task_id columns = this->step.add_rows(name, lines, blocks,
+        [=] (int begin, int end) {
+          fluid::diffuse_lines_i(T, x, x0, k, dt,
+              begin * COLUMNS_PER_LINE, std::min(T, end * COLUMNS_PER_LINE));
+        },
+        after);
+    const task_graph::task_id rows = this->step.add_rows(name, T, blocks,
+        [=] (int begin, int end) { fluid::diffuse_lines_j(T, x, k, dt, begin, end); },
+        { columns });
+
+    // written once, after every block, rather than by each of them
+    return this->step.add(name, [=] { *done = 2; }, { rows });
+  }
+
+  return this->step.add(name, [=] {
+      *done = fluid::diffuse(T, x, x0, k, dt, limit_until(this->frame_start, this->frame_budget, share));
+    }, after);
+}
+
+// The step is built as a task graph. Velocity stages ping-pong between
+// vec_* and tmp_vec_* without swapping, so every stage knows its buffers
+// up front and the result ends up back in vec_*:
+//
+//   advect x, advect y          vec     -> tmp_vec   (row blocks)
+//   body force x, body force y  tmp_vec -> vec       (row blocks, after both advections,
+//                                                     with the emitters)
+//   viscosity x, viscosity y    vec     -> tmp_vec
+//   pressure                    tmp_vec -> vec
+//   advect density              dens    -> tmp_dens  (row blocks)
+//   diffuse density             tmp_dens -> dens
+//
+// with the ADI solver each diffusion becomes two row-block stages of the
+// same name, the columns solved first and then the rows.
+task_graph::task_id smoke_sim::evolve_vec (double dt) {
+  const int T      = this->T;
+  const int blocks = this->workers.get_thread_count() * 2;
+
+  double** vx  = this->vec_x;
+  double** vy  = this->vec_y;
+  double** tvx = this->tmp_vec_x;
+  double** tvy = this->tmp_vec_y;
+
+  const task_graph::task_id advect_x = this->step.add_rows("advect vec_x", T, blocks,
+      [=] (int begin, int end) { fluid::advect(T, tvx, vx, vx, vy, dt, begin, end); });
+  const task_graph::task_id advect_y = this->step.add_rows("advect vec_y", T, blocks,
+      [=] (int begin, int end) { fluid::advect(T, tvy, vy, vx, vy, dt, begin, end); });
+
+  // both advections read vec_x and vec_y, so neither may be overwritten earlier.
+  // the emitters are applied in the same pass, their density along with x
+  // since dens is not read until the density stages
+  const task_graph::task_id force_x = this->step.add_rows("body force x", T, blocks,
+      [=] (int begin, int end) {
+        fluid::body_force (T, vx, tvx, this->force_x, dt, this->sources, fluid::VELOCITY_X, begin, end);
+        fluid::emit       (T, this->dens, this->sources, fluid::DENSITY, dt, begin, end);
+      },
+      { advect_x, advect_y });
+  const task_graph::task_id force_y = this->step.add_rows("body force y", T, blocks,
+      [=] (int begin, int end) {
+        fluid::body_force (T, vy, tvy, this->force_y, dt, this->sources, fluid::VELOCITY_Y, begin, end);
+      },
+      { advect_x, advect_y });
+
+  // a single thread would otherwise run whichever it pops first until the
+  // shared deadline and leave the other nothing, so there x goes first and
+  // gets its own, earlier deadline
+  const bool alone = this->workers.get_thread_count() == 1;
+
+  const task_graph::task_id viscosity_x = this->add_diffuse("viscosity x",
+      tvx, vx, this->viscosity, dt, alone ? VISCOSITY_X_ALONE : VISCOSITY_SOLVED,
+      &this->report.viscosity_x, { force_x });
+  const task_graph::task_id viscosity_y = this->add_diffuse("viscosity y",
+      tvy, vy, this->viscosity, dt, VISCOSITY_SOLVED,
+      &this->report.viscosity_y, alone ? std::vector<task_graph::task_id> { force_y, viscosity_x }
+                                       : std::vector<task_graph::task_id> { force_y });
 
   // enforce divergence free of velocity field
   // pressure is solved as a by-product
-  fluid::pressure   (
-      this->T,
-      this->pressure,
-      this->tmp_vec_x,
-      this->tmp_vec_y,
-      this->vec_x,
-      this->vec_y,
-      this->density
-      );
-  std::swap         (this->tmp_vec_x, this->vec_x);
-  std::swap         (this->tmp_vec_y, this->vec_y);
+  return this->step.add("pressure", [=] {
+      this->report.pressure = fluid::pressure(T, this->pressure, vx, vy, tvx, tvy, this->density,
+          limit_until(this->frame_start, this->frame_budget, PRESSURE_SOLVED));
+    }, { viscosity_x, viscosity_y });
 }
 
-void smoke_sim::evolve_dens (double dt) {
-  fluid::advect   (this->T, this->tmp_dens, this->dens, this->vec_x, this->vec_y, dt);
-  std::swap       (this->tmp_dens, this->dens);
+task_graph::task_id smoke_sim::evolve_dens (double dt, task_graph::task_id after) {
+  const int T      = this->T;
+  const int blocks = this->workers.get_thread_count() * 2;
+
+  double** vx = this->vec_x;
+  double** vy = this->vec_y;
+  double** d  = this->dens;
+  double** td = this->tmp_dens;
 
-  fluid::diffuse  (this->T, this->tmp_dens, this->dens, this->diffuse_rate, dt);
-  std::swap       (this->tmp_dens, this->dens);
+  const task_graph::task_id advect = this->step.add_rows("advect density", T, blocks,
+      [=] (int begin, int end) { fluid::advect(T, td, d, vx, vy, dt, begin, end); },
+      { after });
+
+  return this->add_diffuse("diffuse density",
+      d, td, this->diffuse_rate, dt, DIFFUSION_SOLVED, &this->report.diffusion, { advect });
+}
+
+void smoke_sim::simulate (double dt, const std::function<void()>& alongside) {
+  this->frame_start       = fluid::solve_clock::now();
+  this->report.iterations = SOLVER_ITERATIONS;
+
+  this->sources.clear();
+  for (const emitter& e : this->emitters) {
+    fluid::source source;
+    if (e.rasterize(this->T, &source)) this->sources.push_back(source);
+  }
+
+  this->step.clear();
+  const task_graph::task_id done = this->evolve_dens(dt, this->evolve_vec(dt));
+  if (this->exporter) {
+    this->step.add("export", [this, dt] {
+        this->exporter->publish(dt, this->dens, this->vec_x, this->vec_y);
+      }, { done });
+  }
+  if (alongside) this->step.add("alongside", alongside);
+
+  this->workers.run(this->step);
+
+  this->report.elapsed_ms = std::chrono::duration<double, std::milli>(
+      fluid::solve_clock::now() - this->frame_start).count();
 }
 
-void smoke_sim::simulate (double dt) {
-  this->evolve_vec  (dt);
-  this->evolve_dens (dt);
+scheduler* smoke_sim::get_workers () noexcept {
+  return &this->workers;
+}
+
+std::vector<task_graph::stage_timing> smoke_sim::get_stage_timings () const {
+  return this->step.get_timings();
 }
 
 void smoke_sim::reset() {
@@ -225,56 +292,63 @@ void smoke_sim::reset() {
   }
 }
 
-smoke_sim::smoke_sim (int T) : T(T), diffuse_rate(10), viscosity(10) {
-  tmp_vec_x = new double*[T+1];
-  tmp_vec_y = new double*[T+1];
-  tmp_dens  = new double*[T+1];
-  vec_x     = new double*[T+1];
-  vec_y     = new double*[T+1];
-  dens      = new double*[T+1];
-  pressure  = new double*[T+1];
-  force_x   = new double*[T+1];
-  force_y   = new double*[T+1];
-  for (int i = 0; i < T+1; ++i) {
-    tmp_vec_x[i] = new double[T+1]();
-    tmp_vec_y[i] = new double[T+1]();
-    tmp_dens [i] = new double[T+1]();
-    vec_x    [i] = new double[T+1]();
-    vec_y    [i] = new double[T+1]();
-    dens     [i] = new double[T+1]();
-    pressure [i] = new double[T+1]();
-    force_x  [i] = new double[T+1]();
-    force_y  [i] = new double[T+1]();
-  }
+void smoke_sim::first_touch () {
+  double** grids[] = { tmp_vec_x, tmp_vec_y, tmp_dens, vec_x, vec_y, dens, pressure };
+
+  // one pinned block per thread covers the same rows as that thread's share
+  // of every row-blocked stage, so pages are faulted in on its NUMA node.
+  // the pool's threads are bound to their CPUs; the calling thread's share
+  // lands on whichever node it happens to run on
+  task_graph touch;
+  touch.add_rows("first touch", T+1, this->workers.get_thread_count(),
+      [&grids, this] (int begin, int end) {
+        for (double** grid : grids) {
+          for (int i = begin; i < end; ++i) {
+            std::fill(grid[i], grid[i] + T+1, 0.0);
+          }
+        }
+      }, {}, true);
+  this->workers.run(touch);
 }
 
-smoke_sim::smoke_sim (const smoke_sim& sim) : T(sim.T), diffuse_rate(10), viscosity(10) {
-  this->tmp_vec_x = sim.tmp_vec_x;
-  this->tmp_vec_y = sim.tmp_vec_y;
-  this->tmp_dens  = sim.tmp_dens;
-
-  this->vec_x = sim.vec_x;
-  this->vec_y = sim.vec_y;
-  this->dens  = sim.dens;
-  this->pressure = sim.pressure;
+smoke_sim::smoke_sim (int T)
+  : T(T), memory(7 * arena::grid_bytes(T)),
+    diffuse_rate(10), viscosity(10), solver(diffuse_solver::gauss_seidel),
+    force_x(T), force_y(T), frame_budget(0)
+{
+  tmp_vec_x = memory.grid(T);
+  tmp_vec_y = memory.grid(T);
+  tmp_dens  = memory.grid(T);
+  vec_x     = memory.grid(T);
+  vec_y     = memory.grid(T);
+  dens      = memory.grid(T);
+  pressure  = memory.grid(T);
+
+  this->first_touch();
 }
 
-smoke_sim::~smoke_sim () {
+smoke_sim::smoke_sim (const smoke_sim& sim)
+  : smoke_sim(sim.T)
+{
+  this->diffuse_rate = sim.diffuse_rate;
+  this->viscosity    = sim.viscosity;
+  this->density      = sim.density;
+  this->solver       = sim.solver;
+  this->frame_budget = sim.frame_budget;
+  this->force_x      = sim.force_x;
+  this->force_y      = sim.force_y;
+  this->emitters     = sim.emitters;
+
   for (int i = 0; i < T+1; ++i) {
-    delete[] tmp_dens[i];
-    delete[] tmp_vec_x[i];
-    delete[] tmp_vec_y[i];
-    delete[] dens[i];
-    delete[] vec_x[i];
-    delete[] vec_y[i];
-    delete[] pressure[i];
+    std::copy(sim.tmp_vec_x[i], sim.tmp_vec_x[i] + T+1, this->tmp_vec_x[i]);
+    std::copy(sim.tmp_vec_y[i], sim.tmp_vec_y[i] + T+1, this->tmp_vec_y[i]);
+    std::copy(sim.tmp_dens [i], sim.tmp_dens [i] + T+1, this->tmp_dens [i]);
+    std::copy(sim.vec_x    [i], sim.vec_x    [i] + T+1, this->vec_x    [i]);
+    std::copy(sim.vec_y    [i], sim.vec_y    [i] + T+1, this->vec_y    [i]);
+    std::copy(sim.dens     [i], sim.dens     [i] + T+1, this->dens     [i]);
+    std::copy(sim.pressure [i], sim.pressure [i] + T+1, this->pressure [i]);
   }
-
-  delete[] tmp_dens;
-  delete[] tmp_vec_x;
-  delete[] tmp_vec_y;
-  delete[] dens;
-  delete[] vec_x;
-  delete[] vec_y;
-  delete[] pressure;
 }
+
+// grids are released with the arena
+smoke_sim::~smoke_sim () {}
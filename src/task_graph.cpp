@@ -0,0 +1,229 @@
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "task_graph.hpp"
+
+task_graph::task_id task_graph::add (
+    const std::string& name,
+    std::function<void()> fn,
+    const std::vector<task_id>& after)
+{
+  const task_id id = (task_id) this->tasks.size();
+  this->tasks.push_back({ name, std::move(fn), {}, (int) after.size(), 0.0, 0.0 });
+  for (task_id dep : after) {
+    this->tasks[dep].successors.push_back(id);
+  }
+  return id;
+}
+
+task_graph::task_id task_graph::add_rows (
+    const std::string& name,
+    int n,
+    int blocks,
+    std::function<void(int, int)> fn,
+    const std::vector<task_id>& after,
+    bool pinned)
+{
+  blocks = std::max(1, std::min(blocks, n));
+
+  std::vector<task_id> parts;
+  for (int b = 0; b < blocks; ++b) {
+    const int begin = (int) ((long long) n * b / blocks);
+    const int end   = (int) ((long long) n * (b+1) / blocks);
+    const task_id id = this->add(name, [fn, begin, end] { fn(begin, end); }, after);
+
+    this->tasks[id].block  = b;
+    this->tasks[id].blocks = blocks;
+    this->tasks[id].pinned = pinned;
+    parts.push_back(id);
+  }
+
+  // an empty join task, so later stages depend on one id instead of every block
+  return this->add(name, nullptr, parts);
+}
+
+void task_graph::clear () noexcept {
+  this->tasks.clear();
+}
+
+std::vector<task_graph::stage_timing> task_graph::get_timings () const {
+  std::vector<stage_timing> timings;
+  for (const task& t : this->tasks) {
+    auto it = std::find_if(timings.begin(), timings.end(),
+        [&t] (const stage_timing& s) { return s.name == t.name; });
+
+    if (it == timings.end()) {
+      timings.push_back({ t.name, t.start_ms, t.end_ms, t.end_ms - t.start_ms });
+    } else {
+      it->start_ms  = std::min(it->start_ms, t.start_ms);
+      it->end_ms    = std::max(it->end_ms,   t.end_ms);
+      it->busy_ms  += t.end_ms - t.start_ms;
+    }
+  }
+  return timings;
+}
+
+void scheduler::push (int worker, task_graph::task_id id) {
+  const task_graph::task& t = this->graph->tasks[id];
+  if (t.block >= 0) {
+    worker = (int) ((long long) t.block * this->thread_count / t.blocks);
+  }
+
+  {
+    std::lock_guard<std::mutex> guard(this->queues[worker]->lock);
+    this->queues[worker]->ready.push_back(id);
+  }
+  {
+    std::lock_guard<std::mutex> guard(this->sleep_lock);
+    ++this->held[worker];
+    this->stealable += !t.pinned;
+  }
+  // wake everyone, the task may be pinned to a thread other than the first to wake
+  this->wake.notify_all();
+}
+
+bool scheduler::pop (int worker, task_graph::task_id* id) {
+  // newest own task first, it is the most likely to find its inputs in cache
+  for (int k = 0; k < this->thread_count; ++k) {
+    const int victim = (worker + k) % this->thread_count;
+    worker_queue& q = *this->queues[victim];
+
+    std::lock_guard<std::mutex> guard(q.lock);
+    if (q.ready.empty()) continue;
+
+    if (k == 0) {
+      *id = q.ready.back();
+      q.ready.pop_back();
+    } else {
+      // oldest task the victim does not have to run itself
+      auto it = std::find_if(q.ready.begin(), q.ready.end(),
+          [this] (task_graph::task_id t) { return !this->graph->tasks[t].pinned; });
+      if (it == q.ready.end()) continue;
+      *id = *it;
+      q.ready.erase(it);
+    }
+
+    std::lock_guard<std::mutex> sleep_guard(this->sleep_lock);
+    --this->held[victim];
+    this->stealable -= !this->graph->tasks[*id].pinned;
+    return true;
+  }
+  return false;
+}
+
+void scheduler::execute (int worker, task_graph::task_id id) {
+  using ms = std::chrono::duration<double, std::milli>;
+
+  task_graph::task& t = this->graph->tasks[id];
+
+  t.start_ms = ms(std::chrono::steady_clock::now() - this->run_start).count();
+  if (t.fn) t.fn();
+  t.end_ms   = ms(std::chrono::steady_clock::now() - this->run_start).count();
+
+  for (task_graph::task_id next : t.successors) {
+    if (--this->pending[next] == 0) this->push(worker, next);
+  }
+
+  if (--this->remaining == 0) {
+    std::lock_guard<std::mutex> guard(this->sleep_lock);
+    this->wake.notify_all();
+  }
+}
+
+void scheduler::work_loop (int worker) {
+  for (;;) {
+    task_graph::task_id id;
+    if (this->pop(worker, &id)) {
+      this->execute(worker, id);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> guard(this->sleep_lock);
+    this->wake.wait(guard, [this, worker] { return this->stop || this->has_work(worker); });
+    if (this->stop) return;
+  }
+}
+
+void scheduler::run (task_graph& graph) {
+  const int n = (int) graph.tasks.size();
+  if (n == 0) return;
+
+  this->graph     = &graph;
+  this->pending.reset(new std::atomic<int>[n]);
+  this->remaining = n;
+  this->run_start = std::chrono::steady_clock::now();
+
+  for (int id = 0; id < n; ++id) {
+    this->pending[id] = graph.tasks[id].dependencies;
+  }
+  for (int id = 0; id < n; ++id) {
+    if (graph.tasks[id].dependencies == 0) this->push(0, id);
+  }
+
+  while (this->remaining > 0) {
+    task_graph::task_id id;
+    if (this->pop(0, &id)) {
+      this->execute(0, id);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> guard(this->sleep_lock);
+    this->wake.wait(guard, [this] { return this->remaining == 0 || this->has_work(0); });
+  }
+
+  this->graph = nullptr;
+}
+
+scheduler::scheduler (int threads)
+  : thread_count (threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+    held         (thread_count, 0),
+    stealable    (0),
+    stop         (false),
+    graph        (nullptr),
+    remaining    (0)
+{
+  for (int w = 0; w < this->thread_count; ++w) {
+    this->queues.emplace_back(new worker_queue());
+  }
+
+  // worker 0 is whichever thread calls run
+  for (int w = 1; w < this->thread_count; ++w) {
+    this->threads.emplace_back(&scheduler::work_loop, this, w);
+  }
+
+#ifdef __linux__
+  // keep worker w on the w-th CPU the process may use, so the rows it
+  // touches first stay on its NUMA node. with fewer CPUs than workers some
+  // would share one, so the OS is left to place them instead
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return;
+  if (CPU_COUNT(&allowed) < this->thread_count) return;
+
+  int cpu = -1;
+  for (int w = 0; w < this->thread_count; ++w) {
+    do ++cpu; while (!CPU_ISSET(cpu, &allowed));
+    if (w == 0) continue;
+
+    cpu_set_t one;
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    pthread_setaffinity_np(this->threads[w-1].native_handle(), sizeof(one), &one);
+  }
+#endif
+}
+
+scheduler::~scheduler () {
+  {
+    std::lock_guard<std::mutex> guard(this->sleep_lock);
+    this->stop = true;
+  }
+  this->wake.notify_all();
+
+  for (std::thread& t : this->threads) {
+    t.join();
+  }
+}
@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <cmath>
+
+#include "upscale.hpp"
+
+namespace {
+
+  // padding of the coarse grid on each side, enough for the outer cubic taps
+  const int   PAD          = 2;
+
+  // lattice spacing of the detail noise in pixels
+  const int   NOISE_CELL   = 8;
+
+  // share of the static noise mixed back into the detail every step, so it
+  // keeps its structure instead of smearing out along the flow
+  const float DETAIL_RELAX = 0.02f;
+
+  inline uint32_t hash (uint32_t x, uint32_t y, uint32_t seed) {
+    uint32_t h = x * 374761393u + y * 668265263u + seed * 2246822519u;
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return h ^ (h >> 16);
+  }
+
+  // tileable value noise in [0, 1] with `cells` lattice cells across
+  float value_noise (float x, float y, int cells_x, int cells_y, uint32_t seed) {
+    const int   x0 = (int) std::floor(x), y0 = (int) std::floor(y);
+    const float tx = x - x0,              ty = y - y0;
+    const float sx = tx * tx * (3 - 2 * tx);
+    const float sy = ty * ty * (3 - 2 * ty);
+
+    auto lattice = [&] (int i, int j) {
+      i = ((i % cells_x) + cells_x) % cells_x;
+      j = ((j % cells_y) + cells_y) % cells_y;
+      return (hash(i, j, seed) & 0xFFFF) / 65535.0f;
+    };
+
+    const float a = lattice(x0, y0)     + sx * (lattice(x0 + 1, y0)     - lattice(x0, y0));
+    const float b = lattice(x0, y0 + 1) + sx * (lattice(x0 + 1, y0 + 1) - lattice(x0, y0 + 1));
+    return a + sy * (b - a);
+  }
+
+  // taps and Catmull-Rom weights mapping `out` samples onto `T` cells
+  void make_taps (int T, int out, std::vector<int>* taps, std::vector<float>* weights) {
+    taps->resize(out);
+    weights->resize(4 * out);
+    for (int p = 0; p < out; ++p) {
+      const double g  = (p + 0.5) * T / out - 0.5;
+      const int    i1 = (int) std::floor(g);
+      const float  t  = g - i1;
+
+      (*taps)[p] = i1 - 1 + PAD;
+      (*weights)[0 * out + p] = 0.5f * (-t * t * t + 2 * t * t - t);
+      (*weights)[1 * out + p] = 0.5f * ( 3 * t * t * t - 5 * t * t + 2);
+      (*weights)[2 * out + p] = 0.5f * (-3 * t * t * t + 4 * t * t + t);
+      (*weights)[3 * out + p] = 0.5f * ( t * t * t - t * t);
+    }
+  }
+
+  // cell and offset of every output sample for bilinear lookups of a T x T
+  // cell centered grid, clamped so that cell + 1 stays inside it
+  void make_cells (int T, int out, std::vector<int>* cells, std::vector<float>* fracs) {
+    cells->resize(out);
+    fracs->resize(out);
+    for (int p = 0; p < out; ++p) {
+      const float g = std::min<float>(T - 1, std::max(0.0f, (p + 0.5f) * T / out - 0.5f));
+      const int   c = std::max(0, std::min(T - 2, (int) g));
+      (*cells)[p] = c;
+      (*fracs)[p] = g - c;
+    }
+  }
+}
+
+void upscaler::horizontal_pass (int j_begin, int j_end) {
+  const int    stride = this->T + 2 * PAD;
+  const int*   taps   = this->tap_x.data();
+  const float* w0     = this->weight_x.data();
+  const float* w1     = w0 + this->width;
+  const float* w2     = w1 + this->width;
+  const float* w3     = w2 + this->width;
+
+  for (int j = j_begin; j < j_end; ++j) {
+    const float* __restrict__ src = &this->coarse[j * stride];
+    float*       __restrict__ out = &this->columns[j * this->width];
+
+    for (int x = 0; x < this->width; ++x) {
+      const int   k  = taps[x];
+      const float v  = w0[x] * src[k] + w1[x] * src[k+1] + w2[x] * src[k+2] + w3[x] * src[k+3];
+      const float lo = std::min(src[k+1], src[k+2]);
+      const float hi = std::max(src[k+1], src[k+2]);
+      out[x] = std::min(hi, std::max(lo, v));
+    }
+  }
+}
+
+void upscaler::vertical_pass (int y_begin, int y_end, uint32_t rgb) {
+  for (int y = y_begin; y < y_end; ++y) {
+    const int   k  = this->tap_y[y];
+    const float w0 = this->weight_y[0 * this->height + y];
+    const float w1 = this->weight_y[1 * this->height + y];
+    const float w2 = this->weight_y[2 * this->height + y];
+    const float w3 = this->weight_y[3 * this->height + y];
+
+    const float* __restrict__ r0  = &this->columns[(k+0) * this->width];
+    const float* __restrict__ r1  = &this->columns[(k+1) * this->width];
+    const float* __restrict__ r2  = &this->columns[(k+2) * this->width];
+    const float* __restrict__ r3  = &this->columns[(k+3) * this->width];
+    const float* __restrict__ d   = &this->detail[y * this->width];
+    uint32_t*    __restrict__ out = &this->pixels[y * this->width];
+
+    // with the detail off its strength is zero, which keeps one loop body
+    const float strength = this->detail_enabled ? this->detail_strength : 0.0f;
+
+    for (int x = 0; x < this->width; ++x) {
+      const float v  = w0 * r0[x] + w1 * r1[x] + w2 * r2[x] + w3 * r3[x];
+      const float lo = std::min(r1[x], r2[x]);
+      const float hi = std::max(r1[x], r2[x]);
+      const float s  = std::min(hi, std::max(lo, v)) * (1.0f + strength * (d[x] - 1.0f));
+
+      const int alpha = std::min(255, std::max(0, (int) (s * 256)));
+      out[x] = ((uint32_t) alpha << 24) | rgb;
+    }
+  }
+}
+
+void upscaler::advect_rows (int y_begin, int y_end, float dt) {
+  const int w = this->width, h = this->height;
+
+  // pixels per cell, to turn a velocity in cells per unit time into pixels
+  const float scale_x = (float) w / this->T;
+  const float scale_y = (float) h / this->T;
+
+  for (int y = y_begin; y < y_end; ++y) {
+    const int    j0 = this->cell_y[y];
+    const float  ty = this->frac_y[y];
+    const float* u0 = &this->velocity_x[j0 * this->T];
+    const float* u1 = u0 + this->T;
+    const float* v0 = &this->velocity_y[j0 * this->T];
+    const float* v1 = v0 + this->T;
+
+    for (int x = 0; x < w; ++x) {
+      const int   i0 = this->cell_x[x];
+      const float tx = this->frac_x[x];
+
+      const float u = (1 - ty) * (u0[i0] + tx * (u0[i0+1] - u0[i0])) + ty * (u1[i0] + tx * (u1[i0+1] - u1[i0]));
+      const float v = (1 - ty) * (v0[i0] + tx * (v0[i0+1] - v0[i0])) + ty * (v1[i0] + tx * (v1[i0+1] - v1[i0]));
+
+      // trace back and wrap, the texture tiles; far displacements are cut to
+      // one tile so a single wrap is enough
+      float sx = x - std::max(-(float) w, std::min((float) w, u * dt * scale_x));
+      float sy = y - std::max(-(float) h, std::min((float) h, v * dt * scale_y));
+      sx += sx < 0 ? w : 0;
+      sy += sy < 0 ? h : 0;
+
+      const int   xa = (int) sx,  ya = (int) sy;
+      const float fx = sx - xa,   fy = sy - ya;
+      const int   x0 = xa >= w ? xa - w : xa, x1 = x0 + 1 >= w ? 0 : x0 + 1;
+      const int   y0 = ya >= h ? ya - h : ya, y1 = y0 + 1 >= h ? 0 : y0 + 1;
+
+      const float* r0 = &this->detail[y0 * w];
+      const float* r1 = &this->detail[y1 * w];
+      const float  d  = (1 - fy) * (r0[x0] + fx * (r0[x1] - r0[x0])) + fy * (r1[x0] + fx * (r1[x1] - r1[x0]));
+
+      const size_t index = (size_t) y * w + x;
+      this->detail_tmp[index] = d + DETAIL_RELAX * (this->noise[index] - d);
+    }
+  }
+}
+
+void upscaler::advect_detail (double** vec_x, double** vec_y, double dt) {
+  if (!this->detail_enabled || this->T < 2) return;
+
+  for (int j = 0; j < this->T; ++j) {
+    for (int i = 0; i < this->T; ++i) {
+      this->velocity_x[j * this->T + i] = 0.5 * (vec_x[i][j] + vec_x[i+1][j]);
+      this->velocity_y[j * this->T + i] = 0.5 * (vec_y[i][j] + vec_y[i][j+1]);
+    }
+  }
+
+  const float step = dt;
+  this->passes.clear();
+  this->passes.add_rows("advect detail", this->height, this->workers.get_thread_count() * 2,
+      [this, step] (int begin, int end) { this->advect_rows(begin, end, step); });
+  this->workers.run(this->passes);
+
+  std::swap(this->detail, this->detail_tmp);
+}
+
+const uint32_t* upscaler::render (double** dens, uint8_t r, uint8_t g, uint8_t b) {
+  const int stride = this->T + 2 * PAD;
+  for (int j = 0; j < stride; ++j) {
+    const int cj = std::min(this->T - 1, std::max(0, j - PAD));
+    for (int i = 0; i < stride; ++i) {
+      const int ci = std::min(this->T - 1, std::max(0, i - PAD));
+      this->coarse[j * stride + i] = dens[ci][cj];
+    }
+  }
+
+  const uint32_t rgb    = ((uint32_t) r << 16) | ((uint32_t) g << 8) | b;
+  const int      blocks = this->workers.get_thread_count() * 2;
+
+  this->passes.clear();
+  const task_graph::task_id horizontal = this->passes.add_rows("upscale horizontal", stride, blocks,
+      [this] (int begin, int end) { this->horizontal_pass(begin, end); });
+  this->passes.add_rows("upscale vertical", this->height, blocks,
+      [this, rgb] (int begin, int end) { this->vertical_pass(begin, end, rgb); },
+      { horizontal });
+  this->workers.run(this->passes);
+
+  return this->pixels.data();
+}
+
+upscaler* upscaler::set_detail (bool enabled, float strength) noexcept {
+  this->detail_enabled  = enabled;
+  this->detail_strength = strength;
+  return this;
+}
+
+upscaler::upscaler (int T, int width, int height, scheduler& workers)
+  : T               (T),
+    width           (width),
+    height          (height),
+    workers         (workers),
+    coarse          ((T + 2 * PAD) * (T + 2 * PAD)),
+    columns         ((T + 2 * PAD) * width),
+    detail_enabled  (false),
+    detail_strength (0.35f),
+    detail          (width * height),
+    detail_tmp      (width * height),
+    noise           (width * height),
+    velocity_x      (T * T),
+    velocity_y      (T * T),
+    pixels          (width * height)
+{
+  make_taps(T, width,  &this->tap_x, &this->weight_x);
+  make_taps(T, height, &this->tap_y, &this->weight_y);
+  make_cells(T, width,  &this->cell_x, &this->frac_x);
+  make_cells(T, height, &this->cell_y, &this->frac_y);
+
+  // two octaves of noise around 1, so the detail modulates rather than adds
+  const int cells_x = std::max(1, width  / NOISE_CELL);
+  const int cells_y = std::max(1, height / NOISE_CELL);
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const float fx = (float) x * cells_x / width;
+      const float fy = (float) y * cells_y / height;
+      const float n  = 0.65f * value_noise(fx,     fy,     cells_x,     cells_y,     1)
+                     + 0.35f * value_noise(fx * 2, fy * 2, cells_x * 2, cells_y * 2, 2);
+      this->noise[y * width + x] = 0.5f + n;
+    }
+  }
+  this->detail = this->noise;
+}